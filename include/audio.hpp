@@ -0,0 +1,82 @@
+#pragma once
+
+#include <SFML/Audio.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+constexpr uint32_t sample_rate = 48000;
+constexpr uint8_t frame_rate = 60; // timers and audio advance once per 60Hz frame
+constexpr uint16_t samples_per_frame = sample_rate / frame_rate,
+                   tone_freq = 400,
+                   tone_period = sample_rate / tone_freq,
+                   tone_wave_size = 2400, // multiple of both tone_period and chunk_size
+                   chunk_size = 48; // 1ms per streamed chunk, SFML keeps 3 queued so the device holds 3ms
+
+/**
+ * audio output of the machine, fed once per frame with the state of the sound timer.
+ * end_frame() is called from the emulation thread and must not allocate or lock
+ */
+class Audio {
+  public:
+    virtual ~Audio() = default;
+
+    virtual void end_frame(const bool tone) = 0;
+};
+
+/* discards the audio, used when running muted */
+class Null_Audio : public Audio {
+  public:
+    void end_frame(const bool) override {}
+};
+
+/* writes the audio as a 16 bit mono PCM wav file, one frame of samples per call */
+class Wav_Audio : public Audio {
+  public:
+    Wav_Audio(const std::string& path);
+    Wav_Audio() = delete;
+    ~Wav_Audio() override;
+
+    void end_frame(const bool tone) override;
+
+  private:
+    std::ofstream _file;
+    uint32_t _sample_count;
+    uint16_t _phase; // position inside the tone wave, keeps the square wave continuous
+};
+
+/**
+ * plays the audio through an SFML sound stream.
+ * the emulation thread pushes one tone flag per frame into a lock free ring,
+ * the audio thread consumes a frame of samples per flag so the beep starts and stops on frame boundaries.
+ * a single flag is kept as a jitter buffer between the emulation's sleep timing and the device clock,
+ * so the tone lags the machine by at most a frame (~16.7ms) plus the 3ms queued in the device, under 20ms
+ */
+class Stream_Audio : public Audio, private sf::SoundStream {
+  public:
+    Stream_Audio();
+    ~Stream_Audio() override;
+
+    void end_frame(const bool tone) override;
+
+  private:
+    static constexpr uint8_t queue_size = 8,
+                             max_queued_frames = 1, // frames allowed to wait before stale ones are skipped
+                             processing_interval_ms = 1; // how often SFML's audio thread refills the device
+
+    bool onGetData(Chunk& data) override;
+    void onSeek(sf::Time time_offset) override;
+
+    /* written by the emulation thread */
+    std::array<std::atomic<bool>, queue_size> _frames;
+    std::atomic<uint32_t> _write_pos;
+    /* written by the audio thread */
+    std::atomic<uint32_t> _read_pos;
+    std::array<sf::Int16, chunk_size> _chunk;
+    uint16_t _frame_offset; // samples already played from the current frame
+    uint16_t _phase;
+    bool _tone;
+    uint8_t _starved_frames; // frames played without a flag from the emulation since the last one
+};
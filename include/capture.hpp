@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class Capture_Format : uint8_t {PPM = 0, PNG = 1, RAW = 2, Y4M = 3};
+
+/**
+ * records completed frames without ever blocking the emulation.
+ * frames are copied into a preallocated pool and encoded by a background thread,
+ * when the pool is full (the disk is slower than the emulation) frames are dropped and counted,
+ * unless the caller has no deadline and asks to wait for the encoder instead.
+ * PPM and PNG write an image sequence numbered by emulated frame, so dropped frames leave gaps,
+ * RAW (8 bit gray) and Y4M a single video stream in which a dropped frame repeats the previous one
+ */
+class Capture {
+  public:
+    Capture(const uint8_t width, const uint8_t height, const uint8_t scale_factor, const std::string& path, const Capture_Format format);
+    Capture() = delete;
+    Capture(const Capture&) = delete;
+    ~Capture();
+
+    void stop();
+
+    template<uint8_t width, uint8_t height>
+    void push(const std::array<std::array<uint8_t, width>, height>& screen, const uint64_t number, const bool wait);
+
+    uint64_t written() const { return _tail.load(std::memory_order_acquire); }
+    uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+  private:
+    static constexpr uint16_t pool_size = 128; // frames that may wait for the encoder, ~2 seconds at 60 frames per second
+
+    const uint8_t _width;
+    const uint8_t _height;
+    const uint8_t _scale_factor;
+    const std::string _path;
+    const Capture_Format _format;
+
+    std::vector<uint8_t> _pool; // pool_size frames of width * height pixels
+    std::array<uint64_t, pool_size> _numbers; // emulated frame number of every frame in the pool
+    std::atomic<uint64_t> _head; // next frame to be pushed, written by the emulation thread
+    std::atomic<uint64_t> _tail; // next frame to be encoded, written by the encoder thread
+    std::atomic<uint64_t> _dropped;
+    std::atomic<bool> _stop;
+
+    /* encoder thread only */
+    std::ofstream _stream; // RAW and Y4M output
+    std::vector<uint8_t> _image; // scaled frame, one byte per pixel
+    bool _started; // whether a frame was encoded yet
+    uint64_t _next_number; // emulated frame number expected next, for filling the gaps of RAW and Y4M
+    std::thread _encoder;
+
+    void encode_loop();
+    void encode(const uint8_t* frame, const uint64_t number);
+    void write_ppm(const uint64_t number);
+    void write_png(const uint64_t number);
+    void write_stream();
+    void write_y4m();
+    std::string sequence_path(const uint64_t number, const std::string& extension) const;
+};
+
+/**
+ * copying a completed frame into the pool
+ *
+ * @param screen matrix which represent the screen to be captured
+ * @param number emulated frame number, frames must be pushed in increasing order
+ * @param wait when the pool is full, wait for the encoder instead of dropping the frame
+ */
+template<uint8_t width, uint8_t height>
+void Capture::push(const std::array<std::array<uint8_t, width>, height>& screen, const uint64_t number, const bool wait) {
+  uint64_t head = _head.load(std::memory_order_relaxed);
+  while(head - _tail.load(std::memory_order_acquire) >= pool_size) {
+    if(!wait) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  uint8_t* frame = _pool.data() + (head % pool_size) * width * height;
+  for(uint8_t i = 0; i < height; i++)
+    std::copy(screen[i].begin(), screen[i].end(), frame + i * width);
+  _numbers[head % pool_size] = number;
+  _head.store(head + 1, std::memory_order_release);
+}
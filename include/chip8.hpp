@@ -2,48 +2,103 @@
 #include <cstdint>
 #include <array>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
+#include "audio.hpp"
 #include "graphics.hpp"
 
-constexpr uint16_t memory_size = 4096;
+constexpr uint16_t memory_size = 4096,
+                   program_start_addr = 0x200;
 
 constexpr uint8_t general_reg_size = 16, 
                   display_height = 32,
                   display_width = 64,
                   stack_size = 16,
-                  keypad_size = 16; // hex based keypad 0x0-0xF
+                  keypad_size = 16, // hex based keypad 0x0-0xF
+                  instructions_per_frame = 8; // ~480 instructions per second at 60 frames per second
 
 enum class Key_State : uint8_t {RELEASED = 0, PRESSED = 1};
 
-class Chip8 {
+class Gdb_Stub;
+class Capture;
+class Metrics;
+
+/* ways of dispatching opcodes, TABLE is the reference interpreter */
+enum class Backend : uint8_t {TABLE = 0, DECODED = 1};
+
+struct Chip8_Settings {
+  bool headless = false; // no window is created, the machine is driven through step()/run_frame()
+  bool trace = true; // print every executed opcode
+  Backend backend = Backend::TABLE;
+  uint32_t seed = 0; // seed of the random generator, 0 seeds it with the current time
+  bool overlay = false; // draw the attached metrics over the screen
+};
+
+/**
+ * the whole mutable state of the machine, kept trivially copyable 
+ * so a machine can be saved and restored with a single copy
+ */
+struct Machine_State {
+  std::array<uint8_t, memory_size> _memory; // chip8's memory space  
+
+  std::array<uint16_t, stack_size> _stack;
+  /* cpu registers */
+  struct {
+    std::array<uint8_t, general_reg_size> V; // general purpose registers named V0 up to VF
+    uint16_t idx; 
+    uint16_t pc; // program counter
+    uint16_t sp; 
+  } _reg;
+
+  std::array<std::array<uint8_t, display_width>, display_height> _display; // represent the black and white screen, hold the pixel state(1/0)
+  std::array<uint8_t, keypad_size> _keypad;
+  /* timer registers, when set above zero they will count down to zero */ 
+  struct {
+    uint8_t delay;
+    uint8_t sound;      
+  } _timer;
+
+  uint32_t _rng; // state of the random generator used by CXNN
+  uint64_t _cycles; // instructions executed so far
+};
+
+class Chip8 : private Machine_State {
   public:
-    Chip8(const std::string& path);
+    Chip8(const std::string& path, std::unique_ptr<Audio> audio, const Chip8_Settings& settings = Chip8_Settings());
+    Chip8(std::unique_ptr<Audio> audio, const Chip8_Settings& settings = Chip8_Settings());
     Chip8() = delete;
     ~Chip8() = default;
     
     void run();
+    void step();
+    void run_frame();
+    void run_headless(const uint64_t frames);
+
+    Machine_State snapshot() const;
+    void restore(const Machine_State& state);
+    void load_rom(const uint8_t* rom, const size_t size);
+    void set_key(const uint8_t key, const Key_State state);
+    void update_key(const sf::Event& event, const uint8_t state);
+    bool take_draw_flag();
+    const std::array<std::array<uint8_t, display_width>, display_height>& display() const { return _display; }
+    void attach_debugger(Gdb_Stub* debugger);
+    void attach_capture(Capture* capture);
+    void attach_metrics(Metrics* metrics);
 
   private:
+    friend class Gdb_Stub;
+
     /* attributes*/
-    Graphics _graphics;
-    std::array<uint8_t, memory_size> _memory; // chip8's memory space  
-
-    std::array<uint16_t, stack_size> _stack;
-    /* cpu registers */
-    struct {
-      std::array<uint8_t, general_reg_size> V; // general purpose registers named V0 up to VF
-      uint16_t idx; 
-      uint16_t pc; // program counter
-      uint16_t sp; 
-    } _reg;
-
-    std::array<std::array<uint8_t, display_width>, display_height> _display; // represent the black and white screen, hold the pixel state(1/0)
-    std::array<uint8_t, keypad_size> _keypad;
-    /* timer registers, when set above zero they will count down to zero */ 
-    struct {
-      uint8_t delay;
-      uint8_t sound;      
-    } _timer;
+    std::unique_ptr<Graphics> _graphics; // null when running headless
+    std::unique_ptr<Audio> _audio;
+    Gdb_Stub* _debugger; // null when no debugger is attached
+    Capture* _capture; // null when frames aren't recorded
+    Metrics* _metrics; // null when no metrics are collected
+    const Backend _backend;
+    const bool _trace;
+    const bool _overlay;
+    bool _draw_flag; // set when the display changed since it was last drawn
 
     uint16_t _opcode; // saves the current opcode
     struct { /* struct for saving the symbols of an opcode*/
@@ -58,13 +113,28 @@ class Chip8 {
     typedef void (Chip8::*inst_func)();
     std::map<uint16_t, inst_func> _opcode_table; 
 
+    /* every possible opcode resolved ahead of time to its entry in the opcode table */
+    struct Decode_Table {
+      static constexpr uint8_t illegal = 0xFF;
+      std::array<uint8_t, 0x10000> index; // opcode -> position in funcs, illegal if none matches
+      std::vector<inst_func> funcs;
+    };
+    const Decode_Table* _decode_table;
+
     /* methods */
+    Chip8(std::unique_ptr<Audio> audio, const Chip8_Settings& settings, const std::string& title);
+    template<bool debug>
+    void run_loop();
     void handle_opcode();
+    bool execute_table();
+    bool execute_decoded();
+    const Decode_Table* init_decode_table() const;
+    uint8_t next_random();
     void init_fonts();
     void init_opcode_table();
     void load_game(const std::string& path);
+    void end_frame();
     void update_timers();
-    void update_key(const sf::Event& event, const uint8_t state);
     void init_opcode_args();
 
     /* instructions' methods for executing opcodes */
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "chip8.hpp"
+
+/**
+ * runs the reference interpreter and a candidate backend in lockstep on the same ROM,
+ * inputs and seed, comparing their states every few instructions. the interval grows
+ * while the machines agree, and a divergence is bisected down to the exact instruction
+ */
+class Differential {
+  public:
+    Differential(const std::string& path, const Backend candidate, const uint32_t seed);
+    Differential() = delete;
+    ~Differential() = default;
+
+    bool run(const uint64_t max_instructions);
+
+    uint64_t instructions() const { return _instructions; }
+    uint64_t checks() const { return _checks; }
+
+  private:
+    static constexpr uint64_t min_interval = 1,
+                              max_interval = 1 << 16;
+
+    Chip8 _reference;
+    Chip8 _candidate;
+    const uint32_t _seed;
+    uint64_t _instructions; // instructions both machines agreed on
+    uint64_t _checks;
+
+    /* states of both machines at the last check they agreed on */
+    Machine_State _reference_checkpoint;
+    Machine_State _candidate_checkpoint;
+
+    uint64_t run_both(const uint64_t count, bool& reference_ok, bool& candidate_ok);
+    void apply_input(const uint64_t instruction);
+    void rewind();
+    void bisect(uint64_t diverged_after);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+
+/**
+ * GDB remote serial protocol stub, serving a single debugger over a local TCP or UNIX socket.
+ * registers are exposed in this order (multi byte registers are little endian):
+ * V0-VF (8 bit), I, PC, SP (16 bit), DT, ST (8 bit), stack[0]-stack[15] (16 bit).
+ * the layout is also described by target.xml since GDB has no chip8 architecture of its own
+ */
+class Gdb_Stub {
+  public:
+    Gdb_Stub(Chip8& vm, const std::string& address);
+    Gdb_Stub() = delete;
+    Gdb_Stub(const Gdb_Stub&) = delete;
+    ~Gdb_Stub();
+
+    void wait_for_client();
+    void before_step();
+    void after_step();
+    void report_fault();
+    void poll_interrupt();
+    bool attached() const { return _client >= 0; }
+
+  private:
+    enum class Watch_Type : uint8_t {WRITE = 2, READ = 3, ACCESS = 4};
+    struct Watchpoint {
+      Watch_Type type;
+      uint16_t addr;
+      uint16_t len;
+    };
+
+    Chip8& _vm;
+    int _server;
+    int _client;
+    std::string _unix_path; // removed when the stub is destroyed, empty for TCP
+
+    std::bitset<memory_size> _breakpoints;
+    std::vector<Watchpoint> _watchpoints;
+    bool _stepping; // stop after the next instruction
+    std::string _pending_stop; // stop reply to be sent before the next instruction, empty if none
+    bool _skip_breakpoint; // resuming from the current pc must not hit its breakpoint again
+    std::string _watch_hit; // stop reply of a watchpoint hit by the current instruction
+    std::string _last_stop; // answer to '?'
+
+    void serve(const std::string& stop_reply, const bool announce = true);
+    bool handle_packet(const std::string& packet);
+    bool read_packet(std::string& packet);
+    void send_packet(const std::string& data);
+    bool interrupt_requested();
+    void check_watchpoints();
+    void detach();
+
+    std::string read_registers() const;
+    bool write_registers(const std::string& hex);
+    std::string read_register(const uint8_t reg) const;
+    bool write_register(const uint8_t reg, const std::string& hex);
+    static bool valid_register(const uint8_t reg, const uint32_t value);
+    void set_register(const uint8_t reg, const uint32_t value);
+    std::string read_memory(const std::string& args) const;
+    bool write_memory(const std::string& args);
+    bool update_point(const std::string& args, const bool insert);
+};
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <string>
 #include <array>
+#include "fonts.hpp"
 
 class Graphics {
   public:
@@ -12,12 +13,14 @@ class Graphics {
     ~Graphics() = default;
 
     template<uint8_t width, uint8_t height>
-    void draw_window(const std::array<std::array<uint8_t, width>, height>& screen);
+    void draw_window(const std::array<std::array<uint8_t, width>, height>& screen, const std::string& overlay = "");
     
     sf::RenderWindow window;
 
   private:
     const uint8_t _scale_factor;
+
+    void draw_overlay(const std::string& overlay);
 };
 
 /**
@@ -25,9 +28,10 @@ class Graphics {
  * based on the values of matrix which represent the screen
  * 
  * @param screen matrix which represent the screen to be drawn
+ * @param overlay text drawn over the top left corner of the screen (hex digits, spaces and new lines)
  */
 template<uint8_t width, uint8_t height>
-void Graphics::draw_window(const std::array<std::array<uint8_t, width>, height>& screen) {
+void Graphics::draw_window(const std::array<std::array<uint8_t, width>, height>& screen, const std::string& overlay) {
   window.clear(sf::Color::Black);
   sf::RectangleShape pxl(sf::Vector2f(_scale_factor, _scale_factor));
   for(int i = 0; i < height; i++) {
@@ -39,6 +43,8 @@ void Graphics::draw_window(const std::array<std::array<uint8_t, width>, height>&
       }
     }
   }
+  if(!overlay.empty())
+    draw_overlay(overlay);
   window.display();
 }
 
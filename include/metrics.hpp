@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr size_t cache_line_size = 64;
+
+/**
+ * log-linear histogram in the spirit of HdrHistogram: values below 64 get their own bucket,
+ * above that every power of two is split into 32 buckets, keeping the error of a percentile under ~3%.
+ * values are clamped to 32 bits (~4.3 seconds of nanoseconds). single writer, any amount of readers
+ */
+class Histogram {
+  public:
+    Histogram();
+
+    void record(uint64_t value);
+    uint64_t percentile(const double fraction) const;
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return _sum.load(std::memory_order_relaxed); }
+
+  private:
+    static constexpr uint8_t sub_bucket_bits = 6;
+    static constexpr uint16_t sub_bucket_count = 1 << sub_bucket_bits,
+                              half_count = sub_bucket_count / 2,
+                              bucket_count = sub_bucket_count + (32 - sub_bucket_bits) * half_count;
+
+    std::array<std::atomic<uint64_t>, bucket_count> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+
+    static uint16_t bucket_index(const uint64_t value);
+    static uint64_t bucket_value(const uint16_t index);
+};
+
+/**
+ * live performance counters of a single machine. they are written only by the thread running the machine
+ * (plain load + store, no locked instructions) and read by the exporter, every group of counters
+ * sits on its own cache line so instances running on different threads never share one.
+ * every instance registers itself for export while it lives
+ */
+class Metrics {
+  public:
+    typedef std::chrono::steady_clock::duration Duration;
+
+    Metrics(const std::string& machine);
+    Metrics() = delete;
+    Metrics(const Metrics&) = delete;
+    ~Metrics();
+
+    void record_frame(const uint64_t instructions, const Duration dispatch, const Duration render,
+                      const Duration sleep, const Duration frame_time, const bool late);
+    void record_dropped(const uint64_t frames);
+    std::string overlay_text();
+
+    static std::string export_text();
+
+  private:
+    struct alignas(cache_line_size) Counters {
+      std::atomic<uint64_t> instructions;
+      std::atomic<uint64_t> frames;
+      std::atomic<uint64_t> late_frames;
+      std::atomic<uint64_t> dropped_frames;
+      std::atomic<uint64_t> dispatch_ns;
+      std::atomic<uint64_t> render_ns;
+      std::atomic<uint64_t> sleep_ns;
+    };
+
+    const std::string _machine; // value of the exported machine label
+    Counters _counters;
+    alignas(cache_line_size) Histogram _frame_time_ns;
+
+    /* last sample taken for the overlay, touched only by the machine's thread */
+    std::chrono::steady_clock::time_point _overlay_time;
+    uint64_t _overlay_instructions;
+    uint64_t _overlay_frames;
+
+    static std::mutex& registry_mutex();
+    static std::vector<Metrics*>& registry();
+};
+
+/**
+ * exports the metrics of every live machine in the Prometheus text format,
+ * either served over HTTP on a localhost port or rewritten to a file every second
+ */
+class Metrics_Exporter {
+  public:
+    Metrics_Exporter(const std::string& target);
+    Metrics_Exporter() = delete;
+    Metrics_Exporter(const Metrics_Exporter&) = delete;
+    ~Metrics_Exporter();
+
+  private:
+    const std::string _file_path; // empty when serving over HTTP
+    int _server;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+
+    void serve_loop();
+    void write_loop();
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+
+/**
+ * runs many headless machines side by side and shows them as a grid in a single window.
+ * every machine owns a tile of one atlas texture, only the tiles of machines that drew
+ * since the last frame are uploaded and the whole grid is drawn with a single sprite,
+ * so the window, the GL context and the event loop are shared by all of the machines.
+ * keys are sent to every machine, a machine that hits an illegal opcode is halted
+ */
+class Wall {
+  public:
+    Wall(const std::vector<std::string>& paths);
+    Wall() = delete;
+    Wall(const Wall&) = delete;
+    ~Wall() = default;
+
+    void run();
+
+  private:
+    std::vector<std::unique_ptr<Chip8>> _machines;
+    std::vector<bool> _halted;
+    const uint16_t _columns;
+    const uint16_t _rows;
+
+    sf::RenderWindow _window;
+    sf::Texture _atlas;
+    sf::Sprite _sprite;
+    std::vector<sf::Uint8> _tile; // RGBA pixels of a single tile, reused for every upload
+
+    void run_frame();
+    void update_tile(const size_t machine);
+    uint16_t atlas_width() const;
+    uint16_t atlas_height() const;
+    uint8_t fit_scale_factor() const;
+};
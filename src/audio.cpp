@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <stdexcept>
+#include "audio.hpp"
+
+constexpr int16_t tone_amplitude = 3000;
+
+/**
+ * precomputing the square wave played while the sound timer is active
+ *
+ * @return tone_wave_size samples of a tone_freq square wave
+ */
+static constexpr std::array<int16_t, tone_wave_size> make_tone_wave() {
+  std::array<int16_t, tone_wave_size> wave {};
+  for(uint16_t i = 0; i < tone_wave_size; i++)
+    wave[i] = (i % tone_period) < (tone_period / 2) ? tone_amplitude : -tone_amplitude;
+  return wave;
+}
+
+static constexpr std::array<int16_t, tone_wave_size> tone_wave = make_tone_wave();
+static constexpr std::array<int16_t, samples_per_frame> silence {};
+
+/**
+ * copying samples of the tone (or silence) into a buffer, advancing the phase of the wave
+ *
+ * @param dst buffer to be filled
+ * @param count amount of samples to copy
+ * @param tone whether the tone or silence should be copied
+ * @param phase position inside the tone wave
+ */
+static void fill_samples(int16_t* dst, uint16_t count, const bool tone, uint16_t& phase) {
+  while(count > 0) {
+    uint16_t len = std::min<uint16_t>(count, tone_wave_size - phase);
+    if(tone)
+      std::copy_n(tone_wave.data() + phase, len, dst);
+    else
+      std::fill_n(dst, len, 0);
+    phase = (phase + len) % tone_wave_size;
+    dst += len;
+    count -= len;
+  }
+}
+
+/**
+ * writing a little endian value into a binary stream
+ */
+template<typename T>
+static void write_le(std::ofstream& file, T value) {
+  for(uint8_t i = 0; i < sizeof(T); i++)
+    file.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+/**
+ * constructor, writing a wav header which its sizes are patched when the file is closed
+ *
+ * @param path path of the wav file to be created
+ */
+Wav_Audio::Wav_Audio(const std::string& path) :
+          _file(path, std::ofstream::binary),
+          _sample_count(0),
+          _phase(0)
+{
+  if(!_file)
+    throw std::invalid_argument("can not create wav file");
+
+  _file.write("RIFF", 4);
+  write_le<uint32_t>(_file, 0);
+  _file.write("WAVEfmt ", 8);
+  write_le<uint32_t>(_file, 16);
+  write_le<uint16_t>(_file, 1); // PCM
+  write_le<uint16_t>(_file, 1); // mono
+  write_le<uint32_t>(_file, sample_rate);
+  write_le<uint32_t>(_file, sample_rate * sizeof(int16_t));
+  write_le<uint16_t>(_file, sizeof(int16_t));
+  write_le<uint16_t>(_file, 16);
+  _file.write("data", 4);
+  write_le<uint32_t>(_file, 0);
+}
+
+/**
+ * destructor, patching the RIFF and data chunk sizes
+ */
+Wav_Audio::~Wav_Audio() {
+  uint32_t data_size = _sample_count * sizeof(int16_t);
+  _file.seekp(4);
+  write_le<uint32_t>(_file, 36 + data_size);
+  _file.seekp(40);
+  write_le<uint32_t>(_file, data_size);
+}
+
+/**
+ * writing a frame of samples straight from the precomputed buffers
+ * (samples are written in host order, which matches wav on little endian hosts)
+ *
+ * @param tone whether the sound timer was active during the frame
+ */
+void Wav_Audio::end_frame(const bool tone) {
+  uint16_t count = samples_per_frame;
+  while(count > 0) {
+    uint16_t len = std::min<uint16_t>(count, tone_wave_size - _phase);
+    const int16_t* src = tone ? tone_wave.data() + _phase : silence.data();
+    _file.write(reinterpret_cast<const char*>(src), len * sizeof(int16_t));
+    _phase = (_phase + len) % tone_wave_size;
+    count -= len;
+  }
+  _sample_count += samples_per_frame;
+}
+
+/**
+ * constructor, starting the stream in silence
+ */
+Stream_Audio::Stream_Audio() :
+            _write_pos(0),
+            _read_pos(0),
+            _frame_offset(samples_per_frame),
+            _phase(0),
+            _tone(false),
+            _starved_frames(0)
+{
+  for(auto& frame : _frames)
+    frame.store(false, std::memory_order_relaxed);
+  _chunk.fill(0);
+
+  initialize(1, sample_rate);
+  setProcessingInterval(sf::milliseconds(processing_interval_ms)); // the default 10ms would drain the 3ms queue, needs SFML 2.6
+  play();
+}
+
+/**
+ * destructor, the stream must be stopped before its buffers are destroyed
+ */
+Stream_Audio::~Stream_Audio() {
+  stop();
+}
+
+/**
+ * publishing the tone of the frame that just ended to the audio thread.
+ * if the audio thread fell behind the frame is dropped rather than waiting for it
+ *
+ * @param tone whether the sound timer was active during the frame
+ */
+void Stream_Audio::end_frame(const bool tone) {
+  uint32_t write_pos = _write_pos.load(std::memory_order_relaxed);
+  if(write_pos - _read_pos.load(std::memory_order_acquire) >= queue_size)
+    return;
+  _frames[write_pos % queue_size].store(tone, std::memory_order_relaxed);
+  _write_pos.store(write_pos + 1, std::memory_order_release);
+}
+
+/**
+ * filling the next chunk of the stream (runs on SFML's audio thread).
+ * each queued frame is played for exactly samples_per_frame samples
+ *
+ * @param data chunk to be handed to the audio device
+ * @return always true, the stream never ends
+ */
+bool Stream_Audio::onGetData(Chunk& data) {
+  uint16_t filled = 0;
+  while(filled < chunk_size) {
+    if(_frame_offset == samples_per_frame) {
+      uint32_t read_pos = _read_pos.load(std::memory_order_relaxed),
+               write_pos = _write_pos.load(std::memory_order_acquire);
+      /* skipping stale frames to bound the latency */
+      if(write_pos - read_pos > max_queued_frames)
+        read_pos = write_pos - max_queued_frames;
+      /* when starved the emulation's frame is usually just late, holding the previous tone avoids a dropout.
+         an emulation that stopped pushing (e.g halted by the debugger) is silenced after max_queued_frames */
+      if(read_pos != write_pos) {
+        _tone = _frames[read_pos++ % queue_size].load(std::memory_order_relaxed);
+        _starved_frames = 0;
+      }
+      else if(++_starved_frames > max_queued_frames) {
+        _tone = false;
+        _starved_frames = max_queued_frames;
+      }
+      _read_pos.store(read_pos, std::memory_order_release);
+      _frame_offset = 0;
+    }
+    uint16_t len = std::min<uint16_t>(chunk_size - filled, samples_per_frame - _frame_offset);
+    fill_samples(_chunk.data() + filled, len, _tone, _phase);
+    filled += len;
+    _frame_offset += len;
+  }
+
+  data.samples = _chunk.data();
+  data.sampleCount = chunk_size;
+  return true;
+}
+
+/**
+ * the stream is endless, there is nothing to seek
+ */
+void Stream_Audio::onSeek(sf::Time) {}
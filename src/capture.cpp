@@ -0,0 +1,238 @@
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include "capture.hpp"
+
+constexpr uint8_t y4m_black = 16, y4m_white = 235, y4m_chroma = 128; // video range luma, neutral chroma
+constexpr uint16_t deflate_block_size = 0xFFFF;
+
+/**
+ * @return table for computing the CRC-32 of PNG chunks
+ */
+static std::array<uint32_t, 256> make_crc_table() {
+  std::array<uint32_t, 256> table;
+  for(uint32_t n = 0; n < table.size(); n++) {
+    uint32_t c = n;
+    for(uint8_t k = 0; k < 8; k++)
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+  return table;
+}
+
+/**
+ * appending a big endian 32 bit value
+ */
+static void append_be32(std::vector<uint8_t>& out, const uint32_t value) {
+  for(int8_t shift = 24; shift >= 0; shift -= 8)
+    out.push_back((value >> shift) & 0xFF);
+}
+
+/**
+ * writing a PNG chunk: length, type, data and the CRC of type and data
+ */
+static void write_png_chunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+  static const std::array<uint32_t, 256> crc_table = make_crc_table();
+  std::vector<uint8_t> chunk;
+  append_be32(chunk, data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+
+  uint32_t crc = 0xFFFFFFFFu;
+  for(size_t i = 4; i < chunk.size(); i++)
+    crc = crc_table[(crc ^ chunk[i]) & 0xFF] ^ (crc >> 8);
+  append_be32(chunk, crc ^ 0xFFFFFFFFu);
+  file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+/**
+ * constructor, allocating the frame pool and starting the encoder thread
+ *
+ * @param width width of the captured screen
+ * @param height height of the captured screen
+ * @param scale_factor every pixel is written as a scale_factor x scale_factor square
+ * @param path output file for RAW/Y4M, prefix of the numbered files for PPM/PNG
+ * @param format output format
+ */
+Capture::Capture(const uint8_t width, const uint8_t height, const uint8_t scale_factor, const std::string& path, const Capture_Format format) :
+                _width(width),
+                _height(height),
+                _scale_factor(scale_factor),
+                _path(path),
+                _format(format),
+                _pool(pool_size * width * height, 0),
+                _head(0),
+                _tail(0),
+                _dropped(0),
+                _stop(false),
+                _image(width * height * scale_factor * scale_factor, 0),
+                _started(false),
+                _next_number(0)
+{
+  if(scale_factor == 0)
+    throw std::invalid_argument("capture scale must be positive");
+  if(format == Capture_Format::Y4M && (scale_factor * width % 2 || scale_factor * height % 2))
+    throw std::invalid_argument("y4m capture needs an even frame size");
+
+  if(format == Capture_Format::RAW || format == Capture_Format::Y4M) {
+    _stream.open(path, std::ofstream::binary);
+    if(!_stream)
+      throw std::invalid_argument("can not create capture file");
+    if(format == Capture_Format::Y4M)
+      _stream << "YUV4MPEG2 W" << width * scale_factor << " H" << height * scale_factor << " F60:1 Ip A1:1 C420jpeg\n";
+  }
+  _encoder = std::thread(&Capture::encode_loop, this);
+}
+
+/**
+ * destructor
+ */
+Capture::~Capture() {
+  stop();
+}
+
+/**
+ * stopping the encoder thread, the frames already pushed are encoded before it exits
+ */
+void Capture::stop() {
+  _stop.store(true, std::memory_order_release);
+  if(_encoder.joinable())
+    _encoder.join();
+}
+
+/**
+ * encoding frames as they arrive until the capture is stopped and the pool is drained
+ */
+void Capture::encode_loop() {
+  uint64_t tail = 0;
+  while(true) {
+    if(tail == _head.load(std::memory_order_acquire)) {
+      if(_stop.load(std::memory_order_acquire) && tail == _head.load(std::memory_order_acquire))
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    encode(_pool.data() + (tail % pool_size) * _width * _height, _numbers[tail % pool_size]);
+    _tail.store(++tail, std::memory_order_release);
+  }
+  _stream.flush();
+}
+
+/**
+ * scaling a frame and writing it in the capture's format
+ *
+ * @param frame width * height pixels (1/0)
+ * @param number emulated frame number, names the images of a sequence
+ */
+void Capture::encode(const uint8_t* frame, const uint64_t number) {
+  /* the frames dropped since the last one are filled by repeating it, so the stream keeps its frame rate */
+  if(_started && (_format == Capture_Format::RAW || _format == Capture_Format::Y4M)) {
+    for(; _next_number < number; _next_number++)
+      write_stream();
+  }
+  _started = true;
+  _next_number = number + 1;
+
+  uint16_t scaled_width = _width * _scale_factor;
+  for(uint16_t y = 0; y < _height * _scale_factor; y++) {
+    const uint8_t* src = frame + (y / _scale_factor) * _width;
+    uint8_t* dst = _image.data() + y * scaled_width;
+    for(uint16_t x = 0; x < scaled_width; x++)
+      dst[x] = src[x / _scale_factor] ? 0xFF : 0x00;
+  }
+
+  switch(_format) {
+    case Capture_Format::PPM:
+      write_ppm(number);
+      break;
+    case Capture_Format::PNG:
+      write_png(number);
+      break;
+    case Capture_Format::RAW:
+    case Capture_Format::Y4M:
+      write_stream();
+      break;
+  }
+}
+
+/**
+ * writing the scaled frame to the RAW or Y4M stream
+ */
+void Capture::write_stream() {
+  if(_format == Capture_Format::RAW)
+    _stream.write(reinterpret_cast<const char*>(_image.data()), _image.size());
+  else
+    write_y4m();
+}
+
+/**
+ * writing the scaled frame as a binary (P6) PPM image
+ */
+void Capture::write_ppm(const uint64_t number) {
+  std::ofstream file(sequence_path(number, "ppm"), std::ofstream::binary);
+  file << "P6\n" << _width * _scale_factor << " " << _height * _scale_factor << "\n255\n";
+  for(uint8_t px : _image)
+    file.put(px).put(px).put(px);
+}
+
+/**
+ * writing the scaled frame as an 8 bit grayscale PNG image.
+ * the pixels are stored in uncompressed deflate blocks, so no compression library is needed
+ */
+void Capture::write_png(const uint64_t number) {
+  uint32_t width = _width * _scale_factor, height = _height * _scale_factor;
+  std::ofstream file(sequence_path(number, "png"), std::ofstream::binary);
+  file.write("\x89PNG\r\n\x1A\n", 8);
+
+  std::vector<uint8_t> header;
+  append_be32(header, width);
+  append_be32(header, height);
+  header.insert(header.end(), {8, 0, 0, 0, 0}); // 8 bit depth, grayscale, deflate, no filter, no interlace
+  write_png_chunk(file, "IHDR", header);
+
+  /* every scanline starts with its filter type (none) */
+  std::vector<uint8_t> raw;
+  raw.reserve(height * (width + 1));
+  for(uint32_t y = 0; y < height; y++) {
+    raw.push_back(0);
+    raw.insert(raw.end(), _image.begin() + y * width, _image.begin() + (y + 1) * width);
+  }
+
+  std::vector<uint8_t> zlib {0x78, 0x01};
+  uint32_t adler_a = 1, adler_b = 0;
+  for(size_t pos = 0; pos < raw.size(); pos += deflate_block_size) {
+    uint16_t len = std::min<size_t>(deflate_block_size, raw.size() - pos);
+    zlib.push_back(pos + len == raw.size() ? 1 : 0); // final block flag, stored block type
+    zlib.insert(zlib.end(), {static_cast<uint8_t>(len & 0xFF), static_cast<uint8_t>(len >> 8),
+                             static_cast<uint8_t>(~len & 0xFF), static_cast<uint8_t>((~len >> 8) & 0xFF)});
+    zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+  }
+  for(uint8_t byte : raw) {
+    adler_a = (adler_a + byte) % 65521;
+    adler_b = (adler_b + adler_a) % 65521;
+  }
+  append_be32(zlib, (adler_b << 16) | adler_a);
+  write_png_chunk(file, "IDAT", zlib);
+  write_png_chunk(file, "IEND", {});
+}
+
+/**
+ * writing the scaled frame as a Y4M frame, the picture is monochrome so both chroma planes are neutral
+ */
+void Capture::write_y4m() {
+  _stream << "FRAME\n";
+  for(uint8_t px : _image)
+    _stream.put(px ? y4m_white : y4m_black);
+  size_t chroma_size = _image.size() / 4;
+  for(size_t i = 0; i < 2 * chroma_size; i++)
+    _stream.put(y4m_chroma);
+}
+
+/**
+ * @return path of the image of an emulated frame, e.g. <path>_000042.png
+ */
+std::string Capture::sequence_path(const uint64_t number, const std::string& extension) const {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "_%06llu.", static_cast<unsigned long long>(number));
+  return _path + suffix + extension;
+}
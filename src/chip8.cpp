@@ -9,20 +9,58 @@
 #include <chrono>
 #include <thread>
 #include <iomanip>
+#include <type_traits>
 #include "chip8.hpp"
+#include "gdb_stub.hpp"
+#include "capture.hpp"
+#include "metrics.hpp"
+#include "fonts.hpp"
 #include "utility.hpp"
 
-constexpr uint16_t program_start_addr = 0x200;
-constexpr uint8_t fonts_size = 80,
-                  scale_factor = 10;
+constexpr uint8_t scale_factor = 10,
+                  overlay_period = 30; // frames between two refreshes of the metrics overlay
 
 /**
  * constructor 
  *
  * @param path path for ROM file to be loaded
+ * @param audio output for the sound timer's tone
+ * @param settings how the machine is run
  */
-Chip8::Chip8(const std::string& path) : 
-            _graphics(display_width, display_height, scale_factor, path) 
+Chip8::Chip8(const std::string& path, std::unique_ptr<Audio> audio, const Chip8_Settings& settings) : 
+            Chip8(std::move(audio), settings, path)
+{
+  load_game(path);
+}
+
+/**
+ * constructor of a machine without a program, one is loaded later by load_rom()
+ *
+ * @param audio output for the sound timer's tone
+ * @param settings how the machine is run
+ */
+Chip8::Chip8(std::unique_ptr<Audio> audio, const Chip8_Settings& settings) :
+            Chip8(std::move(audio), settings, "chip8")
+{
+}
+
+/**
+ * constructor, initializing everything but the program
+ *
+ * @param audio output for the sound timer's tone
+ * @param settings how the machine is run
+ * @param title title of the window
+ */
+Chip8::Chip8(std::unique_ptr<Audio> audio, const Chip8_Settings& settings, const std::string& title) : 
+            _graphics(settings.headless ? nullptr : std::make_unique<Graphics>(display_width, display_height, scale_factor, title)),
+            _audio(std::move(audio)),
+            _debugger(nullptr),
+            _capture(nullptr),
+            _metrics(nullptr),
+            _backend(settings.backend),
+            _trace(settings.trace),
+            _overlay(settings.overlay),
+            _draw_flag(false)
 {
   _memory.fill(0);
   _stack.fill(0);
@@ -33,26 +71,53 @@ Chip8::Chip8(const std::string& path) :
   std::memset(&_display, 0, sizeof(_display));
 
   _opcode = 0;
+  _cycles = 0;
   _reg.pc = program_start_addr;
+  /* xorshift must not be seeded with zero, use current time as seed when none is given */
+  _rng = settings.seed ? settings.seed : static_cast<uint32_t>(std::time(nullptr)) | 1u;
   
   init_fonts();
-  load_game(path);
   init_opcode_table();
-
-  std::srand(std::time(nullptr)); // use current time as seed for random generator
+  _decode_table = init_decode_table();
 }
 
 /**
- * handling events of the machine 
+ * handling events of the machine, frame by frame at frame_rate.
+ * the debugger's checks live in their own instantiation of the loop,
+ * so running without a debugger doesn't pay for them
  */
 void Chip8::run() {
+  if(!_graphics)
+    throw std::logic_error("can not run a headless machine");
+
+  while(_graphics->window.isOpen()) {
+    if(_debugger)
+      run_loop<true>();
+    else
+      run_loop<false>();
+  }
+}
+
+/**
+ * the main loop, returns when the window is closed or the debugger detached.
+ * a machine that falls more than a frame behind skips the missed deadlines
+ * instead of running frames back to back to catch up
+ */
+template<bool debug>
+void Chip8::run_loop() {
+  typedef std::chrono::steady_clock clock;
+  constexpr std::chrono::microseconds frame_duration(1000000 / frame_rate);
+  auto frame_start = clock::now();
+  auto next_frame = frame_start + frame_duration;
+  std::string overlay;
+  uint64_t frames = 0;
   sf::Event event;
-  while(_graphics.window.isOpen()) {
-    while(_graphics.window.pollEvent(event)) {
+  while(_graphics->window.isOpen()) {
+    while(_graphics->window.pollEvent(event)) {
       switch (event.type) {
         /* updating the keypad */
         case sf::Event::Closed:
-          _graphics.window.close();
+          _graphics->window.close();
           break;
         case sf::Event::KeyPressed:
           update_key(event, static_cast<uint8_t>(Key_State::PRESSED));
@@ -64,34 +129,238 @@ void Chip8::run() {
           break;
       }  
     }
-    handle_opcode();
-    update_timers();
-    std::this_thread::sleep_for(std::chrono::microseconds(2000)); // Setting delay 
+
+    if constexpr(debug) {
+      _debugger->poll_interrupt();
+      do {
+        _debugger->before_step();
+        try {
+          step();
+        }
+        catch(const std::exception&) {
+          _debugger->report_fault();
+        }
+        _debugger->after_step();
+        if(!_debugger->attached()) {
+          _debugger = nullptr;
+          return;
+        }
+      } while(_cycles % instructions_per_frame);
+    }
+    else
+      run_frame();
+    auto dispatched = clock::now();
+
+    if(_overlay && _metrics && frames++ % overlay_period == 0) {
+      overlay = _metrics->overlay_text();
+      _draw_flag = true;
+    }
+    if(_draw_flag) {
+      _graphics->draw_window<display_width, display_height>(_display, overlay);
+      _draw_flag = false;
+    }
+    auto rendered = clock::now();
+
+    bool late = rendered > next_frame;
+    if(late) {
+      auto missed = (rendered - next_frame) / frame_duration;
+      next_frame += missed * frame_duration;
+      if(_metrics && missed)
+        _metrics->record_dropped(missed);
+    }
+    std::this_thread::sleep_until(next_frame);
+    next_frame += frame_duration;
+
+    auto now = clock::now();
+    if(_metrics)
+      _metrics->record_frame(_cycles, dispatched - frame_start, rendered - dispatched, now - rendered, now - frame_start, late);
+    frame_start = now;
+  }
+}
+
+/**
+ * executing a single instruction, a frame ends every instructions_per_frame instructions
+ */
+void Chip8::step() {
+  handle_opcode();
+  if(++_cycles % instructions_per_frame == 0)
+    end_frame();
+}
+
+/**
+ * executing instructions up to the end of the current frame
+ */
+void Chip8::run_frame() {
+  do {
+    step();
+  } while(_cycles % instructions_per_frame);
+}
+
+/**
+ * running frames as fast as possible without a window
+ *
+ * @param frames amount of frames to be run
+ */
+void Chip8::run_headless(const uint64_t frames) {
+  auto frame_start = std::chrono::steady_clock::now();
+  for(uint64_t frame = 0; frame < frames; frame++) {
+    run_frame();
+    auto now = std::chrono::steady_clock::now();
+    if(_metrics)
+      _metrics->record_frame(_cycles, now - frame_start, {}, {}, now - frame_start, false);
+    frame_start = now;
   }
 }
 
+/**
+ * @return copy of the whole machine state
+ */
+Machine_State Chip8::snapshot() const {
+  return *this;
+}
+
+/**
+ * overwriting the whole machine state
+ *
+ * @param state state to be restored, taken by snapshot()
+ */
+void Chip8::restore(const Machine_State& state) {
+  static_assert(std::is_trivially_copyable<Machine_State>::value, "the machine state must be restorable with a single copy");
+  static_cast<Machine_State&>(*this) = state; // trivial assignment, a single memcpy
+  _draw_flag = true;
+}
+
+/**
+ * setting the state of a keypad key, for driving a headless machine
+ *
+ * @param key hex key 0x0-0xF
+ * @param state new state of the key
+ */
+void Chip8::set_key(const uint8_t key, const Key_State state) {
+  _keypad[key & 0xF] = static_cast<uint8_t>(state);
+}
+
+/**
+ * reading and clearing the draw flag, for drawing a headless machine's display elsewhere
+ *
+ * @return whether the display changed since the flag was last cleared
+ */
+bool Chip8::take_draw_flag() {
+  bool changed = _draw_flag;
+  _draw_flag = false;
+  return changed;
+}
+
+/**
+ * attaching a debugger, from now on the machine runs the debugging loop 
+ *
+ * @param debugger connected debugger stub, must outlive the run
+ */
+void Chip8::attach_debugger(Gdb_Stub* debugger) {
+  _debugger = debugger;
+}
+
+/**
+ * recording every completed frame from now on
+ *
+ * @param capture capture receiving the frames, must outlive the run
+ */
+void Chip8::attach_capture(Capture* capture) {
+  _capture = capture;
+}
+
+/**
+ * collecting performance metrics from now on
+ *
+ * @param metrics metrics of this machine, must outlive the run
+ */
+void Chip8::attach_metrics(Metrics* metrics) {
+  _metrics = metrics;
+}
+
 /**
  * hadling an opcode by executing it if exist or sending error if not
  */
 void Chip8::handle_opcode() {
-  bool exec_opcode = false;
   uint16_t curr_pc = _reg.pc;
-  _opcode = _memory[_reg.pc] << 8 | _memory[_reg.pc + 1];
+  _opcode = _memory[_reg.pc % memory_size] << 8 | _memory[(_reg.pc + 1) % memory_size]; // addresses wrap around the 4K memory
 
-  for(auto inst = _opcode_table.begin(); inst != _opcode_table.cend() && !exec_opcode; inst++) {
+  bool exec_opcode = (_backend == Backend::TABLE) ? execute_table() : execute_decoded();
+ 
+  if(!exec_opcode) {
+    std::cerr << "didn't executed: " << utility::get_hex(_opcode, 4) << " at address: "<< utility::get_hex(curr_pc, 4) << std::endl;
+    throw std::runtime_error("tried to execute illegal opcode");
+  } 
+  if(_trace)
+    std::cout << "executed: " << utility::get_hex(_opcode, 4) << " at address: "<< utility::get_hex(curr_pc, 4) << std::endl;
+}
+
+/**
+ * executing the opcode by searching the opcode table (the reference interpreter)
+ *
+ * @return whether the opcode was found
+ */
+bool Chip8::execute_table() {
+  for(auto inst = _opcode_table.begin(); inst != _opcode_table.cend(); inst++) {
     if(((inst->first & _opcode) == _opcode) && ((inst->first | _opcode) == inst->first)) {
       init_opcode_args();
       (*this.*(inst->second))();
-      exec_opcode = true;
+      return true;
     }
   }
- 
-  if(exec_opcode)
-    std::cout << "executed: " << utility::get_hex(_opcode, 4) << " at address: "<< utility::get_hex(curr_pc, 4) << std::endl;
-  else {
-    std::cerr << "didn't executed: " << utility::get_hex(_opcode, 4) << " at address: "<< utility::get_hex(curr_pc, 4) << std::endl;
-    throw std::runtime_error("tried to execute illegal opcode");
-  } 
+  return false;
+}
+
+/**
+ * executing the opcode through the decode table, a single lookup per opcode
+ *
+ * @return whether the opcode is legal
+ */
+bool Chip8::execute_decoded() {
+  uint8_t inst = _decode_table->index[_opcode];
+  if(inst == Decode_Table::illegal)
+    return false;
+  init_opcode_args();
+  (*this.*(_decode_table->funcs[inst]))();
+  return true;
+}
+
+/**
+ * resolving every possible opcode with the same matching rule as the opcode table.
+ * the table is the same for every machine so it is built only once
+ *
+ * @return the shared decode table
+ */
+const Chip8::Decode_Table* Chip8::init_decode_table() const {
+  static const Decode_Table table = [this]() {
+    Decode_Table decoded;
+    for(const auto& inst : _opcode_table)
+      decoded.funcs.push_back(inst.second);
+    for(uint32_t opcode = 0; opcode < decoded.index.size(); opcode++) {
+      decoded.index[opcode] = Decode_Table::illegal;
+      uint8_t i = 0;
+      for(auto inst = _opcode_table.begin(); inst != _opcode_table.cend(); inst++, i++) {
+        if(((inst->first & opcode) == opcode) && ((inst->first | opcode) == inst->first)) {
+          decoded.index[opcode] = i;
+          break;
+        }
+      }
+    }
+    return decoded;
+  }();
+  return &table;
+}
+
+/**
+ * advancing the xorshift random generator
+ *
+ * @return next random byte
+ */
+uint8_t Chip8::next_random() {
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return static_cast<uint8_t>(_rng >> 24);
 }
 
 /**
@@ -111,15 +380,36 @@ void Chip8::load_game(const std::string& path) {
   game_file.read(reinterpret_cast<char*>(_memory.data() + program_start_addr), memory_size);  
 }
 
+/**
+ * loading a ROM image into memory, for machines constructed without a program
+ *
+ * @param rom ROM's bytes
+ * @param size amount of bytes
+ */
+void Chip8::load_rom(const uint8_t* rom, const size_t size) {
+  if(size > _memory.size() - program_start_addr)
+    throw std::overflow_error("file too big");
+  std::copy(rom, rom + size, _memory.begin() + program_start_addr);
+}
+
+/**
+ * completing a frame: updating the timers and handing the display to the capture
+ */
+void Chip8::end_frame() {
+  update_timers();
+  if(_capture)
+    _capture->push<display_width, display_height>(_display, _cycles / instructions_per_frame - 1, !_graphics); // headless runs have no deadline to miss
+}
 
+/**
+ * counting the timers down once per frame, the tone is played for every frame the sound timer is active 
+ */
 void Chip8::update_timers() {
   if(_timer.delay > 0)
     _timer.delay--;
-if(_timer.sound > 0) {
-    if(_timer.sound == 1)
-      std::cout << "BOOP!" << std::endl;
+  _audio->end_frame(_timer.sound > 0);
+  if(_timer.sound > 0)
     _timer.sound--;
-  }
 }
 
 /**
@@ -179,24 +469,6 @@ void Chip8::init_opcode_table() {
  * initialize the fonts of the program 
  */
 void Chip8::init_fonts() {
-  std::array<uint8_t, fonts_size> fonts { {
-      0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-      0x20, 0x60, 0x20, 0x20, 0x70, // 1
-      0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-      0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-      0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-      0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-      0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-      0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-      0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-      0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-      0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-      0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-      0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-      0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-      0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-      0xF0, 0x80, 0xF0, 0x80, 0x80  // F 
-    } };
   std::copy(fonts.begin(), fonts.end(), _memory.begin());
 }
 
@@ -257,7 +529,8 @@ void Chip8::update_key(const sf::Event& event, const uint8_t state) {
       _keypad[15] = state; 
       break;
     case sf::Keyboard::Escape:
-      _graphics.window.close(); 
+      if(_graphics) // a headless machine has no window, whoever draws it handles escape
+        _graphics->window.close(); 
       break;
     default: 
       break;
@@ -272,6 +545,7 @@ void Chip8::update_key(const sf::Event& event, const uint8_t state) {
  */
 void Chip8::inst_00E0() {
   std::memset(&_display, 0, sizeof(_display));
+  _draw_flag = true;
   _reg.pc += 2;
 }
 
@@ -454,7 +728,7 @@ inline void Chip8::inst_BNNN() {
  * sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN
  */
 inline void Chip8::inst_CXNN() {
-  _reg.V[_opcode_args.x] = (std::rand() % 256) & _opcode_args.nn;
+  _reg.V[_opcode_args.x] = next_random() & _opcode_args.nn;
   _reg.pc += 2;
 }
 
@@ -473,9 +747,10 @@ inline void Chip8::inst_DXYN() {
           sprite_height = _opcode_args.n;
   /* assuming there is no collision */
   _reg.V[0xf] = 0;
-  for (uint8_t row = 0; row < sprite_height; row++) {
-      uint8_t px_to_draw = _memory[_reg.idx + row]; // pixel to draw on the screen
-      for (uint8_t bit_pos {}; bit_pos < 8; bit_pos++) {
+  /* the sprite itself is clipped at the edges of the screen */
+  for (uint8_t row = 0; row < sprite_height && coord_y + row < display_height; row++) {
+      uint8_t px_to_draw = _memory[(_reg.idx + row) % memory_size]; // pixel to draw on the screen
+      for (uint8_t bit_pos {}; bit_pos < 8 && coord_x + bit_pos < display_width; bit_pos++) {
           uint8_t& curr_px = _display[coord_y + row][coord_x + bit_pos]; // current pixel on the screen 
           uint8_t sprite_px = (px_to_draw >> (7 - bit_pos)) & 0x1u; // pixel to be draw 
           /* if both pixels are on -> collision has been occured */
@@ -486,7 +761,7 @@ inline void Chip8::inst_DXYN() {
           curr_px ^= sprite_px;
       }
   }
-  _graphics.draw_window<display_width, display_height>(_display);
+  _draw_flag = true;
   _reg.pc += 2;
 }
 
@@ -494,7 +769,7 @@ inline void Chip8::inst_DXYN() {
  * skips the next instruction if the key stored in VX is pressed
  */ 
 inline void Chip8::inst_EX9E() {
-  if(_keypad[_reg.V[_opcode_args.x]] == static_cast<uint16_t>(Key_State::PRESSED)) 
+  if(_keypad[_reg.V[_opcode_args.x] & 0xF] == static_cast<uint16_t>(Key_State::PRESSED)) 
     _reg.pc += 2;
   _reg.pc += 2;
 }
@@ -503,7 +778,7 @@ inline void Chip8::inst_EX9E() {
  * skips the next instruction if the key stored in VX isn't pressed
  */
 inline void Chip8::inst_EXA1() {
-  if(_keypad[_reg.V[_opcode_args.x]] == static_cast<uint16_t>(Key_State::RELEASED)) 
+  if(_keypad[_reg.V[_opcode_args.x] & 0xF] == static_cast<uint16_t>(Key_State::RELEASED)) 
     _reg.pc += 2; 
   _reg.pc += 2;
 }
@@ -569,9 +844,9 @@ inline void Chip8::inst_FX29() {
  * the middle digit at I plus 1, and the least significant digit at I plus 2
  */
 inline void Chip8::inst_FX33() {
-  _memory[_reg.idx]     = _reg.V[_opcode_args.x] / 100;
-  _memory[_reg.idx + 1] = (_reg.V[_opcode_args.x] / 10) % 10;
-  _memory[_reg.idx + 2] = _reg.V[_opcode_args.x] % 10;
+  _memory[_reg.idx % memory_size] = _reg.V[_opcode_args.x] / 100;
+  _memory[(_reg.idx + 1) % memory_size] = (_reg.V[_opcode_args.x] / 10) % 10;
+  _memory[(_reg.idx + 2) % memory_size] = _reg.V[_opcode_args.x] % 10;
   _reg.pc += 2;
 }
 
@@ -581,7 +856,7 @@ inline void Chip8::inst_FX33() {
  */
 inline void Chip8::inst_FX55() {
   for(uint8_t i = 0; i <= _opcode_args.x; i++)
-    _memory[_reg.idx + i] = _reg.V[i];
+    _memory[(_reg.idx + i) % memory_size] = _reg.V[i];
   _reg.pc += 2;
 }
 
@@ -591,7 +866,7 @@ inline void Chip8::inst_FX55() {
  */ 
 inline void Chip8::inst_FX65() {
   for(uint8_t i = 0; i <= _opcode_args.x; i++)
-    _reg.V[i] = _memory[_reg.idx + i];
+    _reg.V[i] = _memory[(_reg.idx + i) % memory_size];
   _reg.pc += 2;
 }
 
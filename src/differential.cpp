@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include "differential.hpp"
+#include "utility.hpp"
+
+constexpr uint64_t input_period = 64; // instructions between two generated key events
+
+/**
+ * settings of a machine checked by the differential runner
+ */
+static Chip8_Settings headless_settings(const Backend backend, const uint32_t seed) {
+  Chip8_Settings settings;
+  settings.headless = true;
+  settings.trace = false;
+  settings.backend = backend;
+  settings.seed = seed;
+  return settings;
+}
+
+/**
+ * hashing the display with FNV-1a
+ *
+ * @param state machine state holding the display
+ * @return hash of the display
+ */
+static uint64_t display_hash(const Machine_State& state) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for(const auto& row : state._display) {
+    for(uint8_t px : row) {
+      hash ^= px;
+      hash *= 0x100000001B3ull;
+    }
+  }
+  return hash;
+}
+
+/**
+ * comparing the architectural state of two machines
+ *
+ * @return whether the states are the same
+ */
+static bool same_state(const Machine_State& a, const Machine_State& b) {
+  return a._reg.V == b._reg.V &&
+         a._reg.idx == b._reg.idx &&
+         a._reg.pc == b._reg.pc &&
+         a._reg.sp == b._reg.sp &&
+         a._stack == b._stack &&
+         a._timer.delay == b._timer.delay &&
+         a._timer.sound == b._timer.sound &&
+         a._memory == b._memory &&
+         display_hash(a) == display_hash(b);
+}
+
+/**
+ * printing the architectural state of a machine
+ *
+ * @param name name of the machine
+ * @param state state to be printed
+ */
+static void print_state(const std::string& name, const Machine_State& state) {
+  uint16_t opcode = state._memory[state._reg.pc % memory_size] << 8 | state._memory[(state._reg.pc + 1) % memory_size];
+  std::cout << "  [" << name << "] PC: " << utility::get_hex(state._reg.pc, 4)
+            << " opcode: " << utility::get_hex(opcode, 4)
+            << " I: " << utility::get_hex(state._reg.idx, 4)
+            << " SP: " << utility::get_hex(state._reg.sp, 2)
+            << " DT: " << utility::get_hex(state._timer.delay, 2)
+            << " ST: " << utility::get_hex(state._timer.sound, 2)
+            << " display: " << utility::get_hex(display_hash(state), 16) << std::endl;
+  std::cout << "    V:";
+  for(uint8_t v : state._reg.V)
+    std::cout << " " << utility::get_hex(v, 2);
+  std::cout << std::endl << "    stack:";
+  for(uint16_t addr : state._stack)
+    std::cout << " " << utility::get_hex(addr, 4);
+  std::cout << std::endl;
+}
+
+/**
+ * executing a single instruction, an exception thrown by the machine halts it
+ *
+ * @return whether the instruction was executed
+ */
+static bool try_step(Chip8& vm) {
+  try {
+    vm.step();
+    return true;
+  }
+  catch(const std::exception&) {
+    return false;
+  }
+}
+
+/**
+ * constructor
+ *
+ * @param path path for ROM file to be checked
+ * @param candidate backend checked against the reference interpreter
+ * @param seed seed of the random generator and of the generated inputs (0 is replaced by 1)
+ */
+Differential::Differential(const std::string& path, const Backend candidate, const uint32_t seed) :
+                          _reference(path, std::make_unique<Null_Audio>(), headless_settings(Backend::TABLE, seed ? seed : 1)),
+                          _candidate(path, std::make_unique<Null_Audio>(), headless_settings(candidate, seed ? seed : 1)),
+                          _seed(seed ? seed : 1),
+                          _instructions(0),
+                          _checks(0),
+                          _reference_checkpoint(_reference.snapshot()),
+                          _candidate_checkpoint(_candidate.snapshot())
+{
+}
+
+/**
+ * running both machines until they diverge, halt or max_instructions were executed
+ *
+ * @param max_instructions amount of instructions to be checked
+ * @return false if the machines diverged
+ */
+bool Differential::run(const uint64_t max_instructions) {
+  uint64_t interval = min_interval;
+  while(_instructions < max_instructions) {
+    bool reference_ok, candidate_ok;
+    uint64_t executed = run_both(std::min(interval, max_instructions - _instructions), reference_ok, candidate_ok);
+    _checks++;
+
+    Machine_State reference_state = _reference.snapshot(),
+                  candidate_state = _candidate.snapshot();
+    if(reference_ok != candidate_ok || !same_state(reference_state, candidate_state)) {
+      bisect(executed);
+      return false;
+    }
+    if(!reference_ok) {
+      /* both machines halted on the same instruction */
+      _instructions += executed - 1;
+      return true;
+    }
+
+    _instructions += executed;
+    _reference_checkpoint = reference_state;
+    _candidate_checkpoint = candidate_state;
+    interval = std::min(interval * 2, max_interval);
+  }
+  return true;
+}
+
+/**
+ * executing instructions on both machines, stopping once either of them halts
+ *
+ * @param count amount of instructions to be executed
+ * @param reference_ok set to whether the reference executed its last instruction
+ * @param candidate_ok set to whether the candidate executed its last instruction
+ * @return amount of instructions attempted
+ */
+uint64_t Differential::run_both(const uint64_t count, bool& reference_ok, bool& candidate_ok) {
+  reference_ok = candidate_ok = true;
+  uint64_t executed = 0;
+  while(executed < count && reference_ok && candidate_ok) {
+    apply_input(_instructions + executed);
+    reference_ok = try_step(_reference);
+    candidate_ok = try_step(_candidate);
+    executed++;
+  }
+  return executed;
+}
+
+/**
+ * pressing or releasing a key every input_period instructions.
+ * the event only depends on the seed and the instruction, so replaying from a checkpoint repeats it
+ *
+ * @param instruction instruction about to be executed
+ */
+void Differential::apply_input(const uint64_t instruction) {
+  if(instruction % input_period)
+    return;
+  uint64_t hash = (instruction / input_period) ^ (static_cast<uint64_t>(_seed) << 32);
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+  hash ^= hash >> 31;
+
+  uint8_t key = hash & 0xF;
+  Key_State state = (hash >> 4) & 0x1 ? Key_State::PRESSED : Key_State::RELEASED;
+  _reference.set_key(key, state);
+  _candidate.set_key(key, state);
+}
+
+/**
+ * restoring both machines to the last checkpoint they agreed on
+ */
+void Differential::rewind() {
+  _reference.restore(_reference_checkpoint);
+  _candidate.restore(_candidate_checkpoint);
+}
+
+/**
+ * replaying from the last checkpoint to find the first instruction after which the machines differ,
+ * then printing both states before and after it
+ *
+ * @param diverged_after amount of instructions after the checkpoint at which the machines are known to differ
+ */
+void Differential::bisect(uint64_t diverged_after) {
+  bool reference_ok, candidate_ok;
+  uint64_t agreed = 0;
+  while(diverged_after - agreed > 1) {
+    uint64_t mid = agreed + (diverged_after - agreed) / 2;
+    rewind();
+    uint64_t executed = run_both(mid, reference_ok, candidate_ok);
+    if(executed == mid && reference_ok && candidate_ok && same_state(_reference.snapshot(), _candidate.snapshot()))
+      agreed = mid;
+    else
+      diverged_after = mid;
+  }
+
+  rewind();
+  run_both(agreed, reference_ok, candidate_ok);
+  _instructions += agreed;
+  std::cout << "diverged at instruction " << _instructions << ", before it:" << std::endl;
+  print_state("reference", _reference.snapshot());
+  print_state("candidate", _candidate.snapshot());
+
+  run_both(1, reference_ok, candidate_ok);
+  std::cout << "after it:" << std::endl;
+  Machine_State reference_state = _reference.snapshot(),
+                candidate_state = _candidate.snapshot();
+  print_state(reference_ok ? "reference" : "reference (halted)", reference_state);
+  print_state(candidate_ok ? "candidate" : "candidate (halted)", candidate_state);
+
+  auto mismatch = std::mismatch(reference_state._memory.begin(), reference_state._memory.end(), candidate_state._memory.begin());
+  if(mismatch.first != reference_state._memory.end())
+    std::cout << "  memory first differs at " << utility::get_hex(mismatch.first - reference_state._memory.begin(), 4) << ": "
+              << utility::get_hex(*mismatch.first, 2) << " != " << utility::get_hex(*mismatch.second, 2) << std::endl;
+}
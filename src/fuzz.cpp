@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include "chip8.hpp"
+
+constexpr uint32_t fuzz_seed = 1;
+constexpr uint16_t fuzz_max_cycles = 4096; // instructions executed per input, 512 frames
+constexpr uint8_t key_event_size = 2;
+
+/**
+ * libFuzzer entry point, running a fuzzer-provided ROM with a keypad script on a headless machine.
+ *
+ * input layout: [event count n] [n key events] [ROM]
+ * a key event is two bytes: frames to wait before the event, then the key in the low nibble
+ * and whether it is pressed in bit 4. the machine runs for fuzz_max_cycles instructions
+ * or until it executes an illegal opcode.
+ *
+ * the machine is built once, every input starts by restoring its pristine state,
+ * a single copy of Machine_State, rather than by constructing a new machine.
+ * run with -close_fd_mask=2 to silence the interpreter's illegal opcode messages
+ *
+ * @param data fuzzer's input
+ * @param size amount of bytes in the input
+ * @return always 0
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static Chip8 vm = []() {
+    Chip8_Settings settings;
+    settings.headless = true;
+    settings.trace = false;
+    settings.backend = Backend::DECODED;
+    settings.seed = fuzz_seed;
+    return Chip8(std::make_unique<Null_Audio>(), settings);
+  }();
+  static const Machine_State pristine = vm.snapshot();
+
+  if(size == 0)
+    return 0;
+  size_t events = std::min<size_t>(data[0], (size - 1) / key_event_size);
+  const uint8_t* script = data + 1;
+  const uint8_t* rom = script + events * key_event_size;
+  size_t rom_size = std::min<size_t>(data + size - rom, memory_size - program_start_addr); // longer ROMs are truncated
+
+  vm.restore(pristine);
+  vm.load_rom(rom, rom_size);
+
+  size_t next_event = 0;
+  uint64_t next_event_cycle = events ? script[0] * instructions_per_frame : fuzz_max_cycles;
+  try {
+    for(uint16_t cycle = 0; cycle < fuzz_max_cycles; cycle++) {
+      while(next_event < events && cycle == next_event_cycle) {
+        uint8_t event = script[next_event * key_event_size + 1];
+        vm.set_key(event & 0xF, (event & 0x10) ? Key_State::PRESSED : Key_State::RELEASED);
+        if(++next_event < events)
+          next_event_cycle += script[next_event * key_event_size] * instructions_per_frame;
+      }
+      vm.step();
+    }
+  }
+  catch(const std::exception&) { // illegal opcode, the ROM is done
+  }
+  return 0;
+}
@@ -0,0 +1,623 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "gdb_stub.hpp"
+
+constexpr uint8_t reg_count = general_reg_size + 5 + stack_size; // V0-VF, I, PC, SP, DT, ST, stack
+constexpr char hex_digits[] = "0123456789abcdef";
+
+/**
+ * @param reg register number
+ * @return size of the register in bytes
+ */
+static uint8_t reg_size(const uint8_t reg) {
+  if(reg < general_reg_size)
+    return 1;
+  if(reg < general_reg_size + 3)
+    return 2;
+  if(reg < general_reg_size + 5)
+    return 1;
+  return 2;
+}
+
+/**
+ * appending a value as little endian hex bytes, the way registers are sent to the debugger
+ */
+static void append_hex(std::string& out, const uint32_t value, const uint8_t bytes) {
+  for(uint8_t i = 0; i < bytes; i++) {
+    uint8_t byte = (value >> (8 * i)) & 0xFF;
+    out += hex_digits[byte >> 4];
+    out += hex_digits[byte & 0xF];
+  }
+}
+
+/**
+ * parsing little endian hex bytes
+ *
+ * @param hex string holding the bytes
+ * @param pos position of the first byte in the string
+ * @param bytes amount of bytes to parse
+ * @return the parsed value
+ */
+static uint32_t parse_hex(const std::string& hex, const size_t pos, const uint8_t bytes) {
+  if(pos + 2 * bytes > hex.size())
+    throw std::invalid_argument("truncated hex value");
+  if(!std::all_of(hex.begin() + pos, hex.begin() + pos + 2 * bytes, [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); }))
+    throw std::invalid_argument("malformed hex value");
+  uint32_t value = 0;
+  for(uint8_t i = 0; i < bytes; i++)
+    value |= std::stoul(hex.substr(pos + 2 * i, 2), nullptr, 16) << (8 * i);
+  return value;
+}
+
+/**
+ * describing the registers to the debugger
+ *
+ * @return target description document
+ */
+static std::string target_xml() {
+  std::string xml = "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+                    "<target version=\"1.0\"><feature name=\"org.chip8.core\">";
+  auto reg = [&xml](const std::string& name, const uint8_t bits, const std::string& type) {
+    xml += "<reg name=\"" + name + "\" bitsize=\"" + std::to_string(bits) + "\" type=\"" + type + "\"/>";
+  };
+  for(uint8_t i = 0; i < general_reg_size; i++)
+    reg("v" + std::string(1, hex_digits[i]), 8, "uint8");
+  reg("i", 16, "data_ptr");
+  reg("pc", 16, "code_ptr");
+  reg("sp", 16, "uint16");
+  reg("dt", 8, "uint8");
+  reg("st", 8, "uint8");
+  for(uint8_t i = 0; i < stack_size; i++)
+    reg("stack" + std::to_string(i), 16, "code_ptr");
+  return xml + "</feature></target>";
+}
+
+/**
+ * constructor, opening the socket the debugger connects to
+ *
+ * @param vm machine to be debugged
+ * @param address TCP port on localhost, or a UNIX socket path if it contains a '/'
+ */
+Gdb_Stub::Gdb_Stub(Chip8& vm, const std::string& address) :
+                  _vm(vm),
+                  _server(-1),
+                  _client(-1),
+                  _stepping(false),
+                  _skip_breakpoint(false)
+{
+  if(address.find('/') != std::string::npos) {
+    sockaddr_un addr {};
+    if(address.size() >= sizeof(addr.sun_path))
+      throw std::invalid_argument("debugger socket path too long");
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+    _server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(address.c_str());
+    if(_server < 0 || bind(_server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+      throw std::runtime_error("can not bind debugger socket");
+    _unix_path = address;
+  }
+  else {
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(std::stoul(address)));
+    _server = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if(_server >= 0)
+      setsockopt(_server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(_server < 0 || bind(_server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+      throw std::runtime_error("can not bind debugger socket");
+  }
+  if(listen(_server, 1) < 0)
+    throw std::runtime_error("can not listen on debugger socket");
+}
+
+/**
+ * destructor
+ */
+Gdb_Stub::~Gdb_Stub() {
+  if(_client >= 0)
+    close(_client);
+  if(_server >= 0)
+    close(_server);
+  if(!_unix_path.empty())
+    unlink(_unix_path.c_str());
+}
+
+/**
+ * blocking until a debugger connects and resumes the machine.
+ * a freshly attached debugger asks for the stop reason itself, so it isn't announced
+ */
+void Gdb_Stub::wait_for_client() {
+  std::cout << "[GDB]: waiting for a debugger to connect" << std::endl;
+  _client = accept(_server, nullptr, nullptr);
+  if(_client < 0)
+    throw std::runtime_error("can not accept debugger connection");
+  int no_delay = 1;
+  setsockopt(_client, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay)); // fails harmlessly on UNIX sockets
+  serve("S05", false);
+}
+
+/**
+ * checking whether the debugger asked to interrupt the machine, called once per frame
+ * so an interrupt stops the machine before the next frame's first instruction
+ */
+void Gdb_Stub::poll_interrupt() {
+  if(attached() && _pending_stop.empty() && interrupt_requested())
+    _pending_stop = "S02";
+}
+
+/**
+ * checking for stops before an instruction is executed: interrupts, breakpoints and watchpoints
+ */
+void Gdb_Stub::before_step() {
+  if(!_pending_stop.empty()) {
+    std::string reply;
+    reply.swap(_pending_stop);
+    serve(reply);
+  }
+  else if(!_skip_breakpoint && _breakpoints[_vm._reg.pc % memory_size])
+    serve("S05");
+  _skip_breakpoint = false;
+
+  check_watchpoints();
+}
+
+/**
+ * checking for stops after an instruction was executed: watchpoint hits and single steps
+ */
+void Gdb_Stub::after_step() {
+  if(!_watch_hit.empty()) {
+    std::string reply;
+    reply.swap(_watch_hit);
+    serve(reply);
+  }
+  else if(_stepping)
+    serve("S05");
+}
+
+/**
+ * stopping on an instruction the machine failed to execute (illegal opcode, stack over/underflow)
+ */
+void Gdb_Stub::report_fault() {
+  _watch_hit.clear();
+  _stepping = false;
+  serve("S04");
+}
+
+/**
+ * finding the watchpoints accessed by the instruction about to be executed,
+ * only FX33/FX55 write memory and FX65/DXYN read it
+ */
+void Gdb_Stub::check_watchpoints() {
+  if(_watchpoints.empty() || !attached())
+    return;
+
+  uint16_t pc = _vm._reg.pc % memory_size,
+           opcode = _vm._memory[pc] << 8 | _vm._memory[(pc + 1) % memory_size],
+           idx = _vm._reg.idx,
+           len = 0;
+  bool write = false;
+  switch(opcode & 0xF0FF) {
+    case 0xF033:
+      len = 3;
+      write = true;
+      break;
+    case 0xF055:
+      len = ((opcode >> 8) & 0xF) + 1;
+      write = true;
+      break;
+    case 0xF065:
+      len = ((opcode >> 8) & 0xF) + 1;
+      break;
+    default:
+      if((opcode & 0xF000) == 0xD000)
+        len = opcode & 0xF;
+      break;
+  }
+
+  for(const auto& watch : _watchpoints) {
+    if((watch.type == Watch_Type::WRITE && !write) || (watch.type == Watch_Type::READ && write))
+      continue;
+    if(idx < watch.addr + watch.len && watch.addr < idx + len) {
+      _watch_hit = watch.type == Watch_Type::WRITE ? "T05watch:" : (watch.type == Watch_Type::READ ? "T05rwatch:" : "T05awatch:");
+      uint16_t hit_addr = std::max(idx, watch.addr);
+      for(int8_t shift = 12; shift >= 0; shift -= 4)
+        _watch_hit += hex_digits[(hit_addr >> shift) & 0xF];
+      _watch_hit += ';';
+      return;
+    }
+  }
+}
+
+/**
+ * sending a stop reply and serving the debugger's requests until it resumes the machine or detaches
+ *
+ * @param stop_reply reason of the stop
+ * @param announce whether the stop reply is sent right away or only when asked for
+ */
+void Gdb_Stub::serve(const std::string& stop_reply, const bool announce) {
+  if(!attached())
+    return;
+  _last_stop = stop_reply;
+  if(announce)
+    send_packet(stop_reply);
+  std::string packet;
+  while(attached()) {
+    if(!read_packet(packet)) {
+      detach();
+      return;
+    }
+    if(packet == "\x03") // already stopped
+      continue;
+    try {
+      if(handle_packet(packet))
+        return;
+    }
+    catch(const std::exception&) { // malformed request
+      send_packet("E01");
+    }
+  }
+}
+
+/**
+ * handling a single request of the debugger
+ *
+ * @param packet the request
+ * @return whether the machine resumes running
+ */
+bool Gdb_Stub::handle_packet(const std::string& packet) {
+  std::string args = packet.substr(1);
+  switch(packet[0]) {
+    case '?':
+      send_packet(_last_stop);
+      break;
+    case 'g':
+      send_packet(read_registers());
+      break;
+    case 'G':
+      send_packet(write_registers(args) ? "OK" : "E01");
+      break;
+    case 'p':
+      send_packet(read_register(std::stoul(args, nullptr, 16)));
+      break;
+    case 'P': {
+      size_t sep = args.find('=');
+      bool ok = sep != std::string::npos && write_register(std::stoul(args.substr(0, sep), nullptr, 16), args.substr(sep + 1));
+      send_packet(ok ? "OK" : "E01");
+      break;
+    }
+    case 'm':
+      send_packet(read_memory(args));
+      break;
+    case 'M':
+      send_packet(write_memory(args) ? "OK" : "E01");
+      break;
+    case 'Z':
+    case 'z':
+      send_packet(update_point(args, packet[0] == 'Z') ? "OK" : "");
+      break;
+    case 'c':
+      _stepping = false;
+      _skip_breakpoint = true;
+      return true;
+    case 's':
+      _stepping = true;
+      _skip_breakpoint = true;
+      return true;
+    case 'D':
+      send_packet("OK");
+      detach();
+      return true;
+    case 'k':
+      if(_vm._graphics)
+        _vm._graphics->window.close();
+      detach();
+      return true;
+    case 'H':
+      send_packet("OK");
+      break;
+    case 'q':
+      if(packet.rfind("qSupported", 0) == 0)
+        send_packet("PacketSize=1000;qXfer:features:read+");
+      else if(packet == "qAttached")
+        send_packet("1");
+      else if(packet == "qfThreadInfo")
+        send_packet("m1");
+      else if(packet == "qsThreadInfo")
+        send_packet("l");
+      else if(packet.rfind("qXfer:features:read:target.xml:", 0) == 0) {
+        static const std::string xml = target_xml();
+        std::string range = packet.substr(packet.rfind(':') + 1);
+        size_t offset = std::stoul(range.substr(0, range.find(',')), nullptr, 16),
+               length = std::stoul(range.substr(range.find(',') + 1), nullptr, 16);
+        if(offset >= xml.size())
+          send_packet("l");
+        else
+          send_packet((offset + length >= xml.size() ? "l" : "m") + xml.substr(offset, length));
+      }
+      else
+        send_packet("");
+      break;
+    default:
+      send_packet("");
+      break;
+  }
+  return false;
+}
+
+/**
+ * reading a packet from the debugger, acknowledging it
+ *
+ * @param packet set to the packet's data, or to "\x03" for an interrupt
+ * @return false if the debugger disconnected
+ */
+bool Gdb_Stub::read_packet(std::string& packet) {
+  char c;
+  do {
+    if(recv(_client, &c, 1, 0) <= 0)
+      return false;
+    if(c == '\x03') {
+      packet = "\x03";
+      return true;
+    }
+  } while(c != '$');
+
+  packet.clear();
+  while(true) {
+    if(recv(_client, &c, 1, 0) <= 0)
+      return false;
+    if(c == '#')
+      break;
+    packet += c;
+  }
+  char checksum[2];
+  if(recv(_client, checksum, 2, MSG_WAITALL) != 2)
+    return false;
+  send(_client, "+", 1, MSG_NOSIGNAL);
+  return true;
+}
+
+/**
+ * sending a packet to the debugger, the acknowledgement is consumed by the next read
+ *
+ * @param data packet's data
+ */
+void Gdb_Stub::send_packet(const std::string& data) {
+  uint8_t checksum = 0;
+  for(char c : data)
+    checksum += static_cast<uint8_t>(c);
+  std::string packet = "$" + data + "#";
+  packet += hex_digits[checksum >> 4];
+  packet += hex_digits[checksum & 0xF];
+
+  size_t sent = 0;
+  while(sent < packet.size()) {
+    ssize_t len = send(_client, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+    if(len <= 0) {
+      detach();
+      return;
+    }
+    sent += len;
+  }
+}
+
+/**
+ * checking without blocking whether the debugger asked to stop the machine
+ *
+ * @return whether an interrupt was received
+ */
+bool Gdb_Stub::interrupt_requested() {
+  pollfd fd {_client, POLLIN, 0};
+  while(poll(&fd, 1, 0) > 0) {
+    char c;
+    if(recv(_client, &c, 1, 0) <= 0) {
+      detach();
+      return false;
+    }
+    if(c == '\x03')
+      return true;
+  }
+  return false;
+}
+
+/**
+ * closing the connection, the machine keeps running without the debugger
+ */
+void Gdb_Stub::detach() {
+  if(_client >= 0)
+    close(_client);
+  _client = -1;
+  _breakpoints.reset();
+  _watchpoints.clear();
+  _stepping = false;
+  _pending_stop.clear();
+  _watch_hit.clear();
+}
+
+/**
+ * @return every register as hex
+ */
+std::string Gdb_Stub::read_registers() const {
+  std::string hex;
+  for(uint8_t reg = 0; reg < reg_count; reg++)
+    hex += read_register(reg);
+  return hex;
+}
+
+/**
+ * writing every register, the whole payload is checked before any register is written
+ *
+ * @param hex registers as hex, in the order read_registers() sends them
+ * @return whether the payload was valid
+ */
+bool Gdb_Stub::write_registers(const std::string& hex) {
+  std::array<uint32_t, reg_count> values;
+  size_t pos = 0;
+  for(uint8_t reg = 0; reg < reg_count; reg++) {
+    values[reg] = parse_hex(hex, pos, reg_size(reg));
+    if(!valid_register(reg, values[reg]))
+      return false;
+    pos += 2 * reg_size(reg);
+  }
+  if(pos != hex.size())
+    return false;
+  for(uint8_t reg = 0; reg < reg_count; reg++)
+    set_register(reg, values[reg]);
+  return true;
+}
+
+/**
+ * @param reg register number
+ * @return the register as hex, or an error if there is no such register
+ */
+std::string Gdb_Stub::read_register(const uint8_t reg) const {
+  uint32_t value;
+  if(reg < general_reg_size)
+    value = _vm._reg.V[reg];
+  else if(reg == general_reg_size)
+    value = _vm._reg.idx;
+  else if(reg == general_reg_size + 1)
+    value = _vm._reg.pc;
+  else if(reg == general_reg_size + 2)
+    value = _vm._reg.sp;
+  else if(reg == general_reg_size + 3)
+    value = _vm._timer.delay;
+  else if(reg == general_reg_size + 4)
+    value = _vm._timer.sound;
+  else if(reg < reg_count)
+    value = _vm._stack[reg - general_reg_size - 5];
+  else
+    return "E01";
+
+  std::string hex;
+  append_hex(hex, value, reg_size(reg));
+  return hex;
+}
+
+/**
+ * @param reg register number
+ * @param hex new value of the register
+ * @return false if there is no such register or the machine can not hold the value
+ */
+bool Gdb_Stub::write_register(const uint8_t reg, const std::string& hex) {
+  if(reg >= reg_count || hex.size() != 2u * reg_size(reg))
+    return false;
+  uint32_t value = parse_hex(hex, 0, reg_size(reg));
+  if(!valid_register(reg, value))
+    return false;
+  set_register(reg, value);
+  return true;
+}
+
+/**
+ * @param reg register number
+ * @param value value to be written
+ * @return whether the machine can hold the value, sp must stay inside the stack
+ */
+bool Gdb_Stub::valid_register(const uint8_t reg, const uint32_t value) {
+  return reg != general_reg_size + 2 || value < stack_size;
+}
+
+/**
+ * storing a checked value into a register
+ *
+ * @param reg register number
+ * @param value value to be written
+ */
+void Gdb_Stub::set_register(const uint8_t reg, const uint32_t value) {
+  if(reg < general_reg_size)
+    _vm._reg.V[reg] = value;
+  else if(reg == general_reg_size)
+    _vm._reg.idx = value;
+  else if(reg == general_reg_size + 1)
+    _vm._reg.pc = value;
+  else if(reg == general_reg_size + 2)
+    _vm._reg.sp = value;
+  else if(reg == general_reg_size + 3)
+    _vm._timer.delay = value;
+  else if(reg == general_reg_size + 4)
+    _vm._timer.sound = value;
+  else
+    _vm._stack[reg - general_reg_size - 5] = value;
+}
+
+/**
+ * @param args "addr,length"
+ * @return the memory as hex, or an error if the range is outside the memory
+ */
+std::string Gdb_Stub::read_memory(const std::string& args) const {
+  size_t addr = std::stoul(args.substr(0, args.find(',')), nullptr, 16),
+         len = std::stoul(args.substr(args.find(',') + 1), nullptr, 16);
+  if(addr > memory_size || len > memory_size - addr)
+    return "E01";
+  std::string hex;
+  for(size_t i = 0; i < len; i++)
+    append_hex(hex, _vm._memory[addr + i], 1);
+  return hex;
+}
+
+/**
+ * @param args "addr,length:bytes"
+ * @return false if the range is outside the memory
+ */
+bool Gdb_Stub::write_memory(const std::string& args) {
+  size_t sep = args.find(':');
+  size_t addr = std::stoul(args.substr(0, args.find(',')), nullptr, 16),
+         len = std::stoul(args.substr(args.find(',') + 1, sep), nullptr, 16);
+  if(sep == std::string::npos || addr > memory_size || len > memory_size - addr)
+    return false;
+  for(size_t i = 0; i < len; i++)
+    _vm._memory[addr + i] = parse_hex(args, sep + 1 + 2 * i, 1);
+  return true;
+}
+
+/**
+ * inserting or removing a breakpoint or watchpoint
+ *
+ * @param args "type,addr,kind", the kind of a watchpoint is its length
+ * @param insert insert or remove the point
+ * @return false if the type isn't supported or the address is outside the memory
+ */
+bool Gdb_Stub::update_point(const std::string& args, const bool insert) {
+  uint8_t type = args.at(0) - '0';
+  size_t first = args.find(','), second = args.find(',', first + 1);
+  uint16_t addr = std::stoul(args.substr(first + 1, second - first - 1), nullptr, 16),
+           len = std::stoul(args.substr(second + 1), nullptr, 16);
+  if(addr >= memory_size)
+    return false;
+
+  switch(type) {
+    case 0: // software breakpoint
+    case 1: // hardware breakpoint, same thing for an interpreter
+      _breakpoints[addr] = insert;
+      return true;
+    case static_cast<uint8_t>(Watch_Type::WRITE):
+    case static_cast<uint8_t>(Watch_Type::READ):
+    case static_cast<uint8_t>(Watch_Type::ACCESS): {
+      Watch_Type watch_type = static_cast<Watch_Type>(type);
+      auto found = std::find_if(_watchpoints.begin(), _watchpoints.end(), [&](const Watchpoint& watch) {
+        return watch.type == watch_type && watch.addr == addr && watch.len == len;
+      });
+      if(insert && found == _watchpoints.end())
+        _watchpoints.push_back({watch_type, addr, len});
+      else if(!insert && found != _watchpoints.end())
+        _watchpoints.erase(found);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
@@ -1,3 +1,4 @@
+#include <cctype>
 #include "graphics.hpp"
 
 /* *
@@ -18,3 +19,32 @@ Graphics::Graphics(const uint8_t width, const uint8_t height, const uint8_t scal
 }
 
 
+
+/**
+ * drawing text with the machine's hex font, in green so it stands out of the black and white screen 
+ *
+ * @param overlay text to be drawn, characters other than hex digits are left blank
+ */
+void Graphics::draw_overlay(const std::string& overlay) {
+  constexpr uint8_t px_size = 2, glyph_width = 5, glyph_height = font_height + 1; // glyphs are spaced by one pixel
+  sf::RectangleShape pxl(sf::Vector2f(px_size, px_size));
+  pxl.setFillColor(sf::Color(0, 255, 0));
+  uint16_t column = 0, line = 0;
+  for(char c : overlay) {
+    if(c == '\n') {
+      column = 0;
+      line++;
+      continue;
+    }
+    uint8_t glyph = !std::isxdigit(static_cast<unsigned char>(c)) ? 0xFF : (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    for(uint8_t row = 0; row < font_height && glyph != 0xFF; row++) {
+      for(uint8_t bit_pos = 0; bit_pos < 4; bit_pos++) {
+        if((fonts[glyph * font_height + row] >> (7 - bit_pos)) & 0x1u) {
+          pxl.setPosition((column * glyph_width + bit_pos + 1) * px_size, (line * glyph_height + row + 1) * px_size);
+          window.draw(pxl);
+        }
+      }
+    }
+    column++;
+  }
+}
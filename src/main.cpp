@@ -2,17 +2,179 @@
 #include <filesystem>
 #include <string>
 #include <memory>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
 #include "chip8.hpp"
+#include "differential.hpp"
+#include "gdb_stub.hpp"
+#include "capture.hpp"
+#include "metrics.hpp"
+#include "wall.hpp"
+
+constexpr uint32_t diff_seed = 1;
+
+/**
+ * @param paths ROM files and directories
+ * @return the ROM files, directories expanded to the ROMs inside them, sorted
+ */
+static std::vector<std::string> expand_roms(const std::vector<std::string>& paths) {
+  std::vector<std::string> roms;
+  for(const auto& path : paths) {
+    if(std::filesystem::is_directory(path)) {
+      for(const auto& entry : std::filesystem::directory_iterator(path))
+        if(entry.is_regular_file())
+          roms.push_back(entry.path().string());
+    }
+    else
+      roms.push_back(path);
+  }
+  std::sort(roms.begin(), roms.end());
+  return roms;
+}
+
+/**
+ * @param text decimal count given on the command line
+ * @param count set to the parsed count
+ * @return whether the text is a valid count
+ */
+static bool parse_count(const std::string& text, uint64_t& count) {
+  if(text.empty() || !std::all_of(text.begin(), text.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
+    return false;
+  try {
+    count = std::stoull(text);
+  }
+  catch(const std::out_of_range&) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * checking the decoded backend against the reference interpreter on every given ROM,
+ * directories are expanded to the ROMs inside them
+ *
+ * @param max_instructions amount of instructions to check on each ROM
+ * @param paths ROM files and directories
+ * @return 0 if every ROM was checked and none diverged otherwise 1
+ */
+static int run_diff(const uint64_t max_instructions, const std::vector<std::string>& paths) {
+  std::vector<std::string> roms = expand_roms(paths);
+  int failed = 0;
+  for(const auto& rom : roms) {
+    /* a ROM that can't be loaded fails on its own, the rest of the batch is still checked */
+    try {
+      Differential diff{rom, Backend::DECODED, diff_seed};
+      bool same = diff.run(max_instructions);
+      std::cout << "[DIFF] " << rom << ": " << (same ? "ok" : "DIVERGED") << " after " << diff.instructions()
+                << " instructions, " << diff.checks() << " checks" << std::endl;
+      failed += !same;
+    }
+    catch(const std::exception& e) {
+      std::cout << "[DIFF] " << rom << ": FAILED, " << e.what() << std::endl;
+      failed++;
+    }
+  }
+  return failed ? 1 : 0;
+}
+
+/**
+ * running many machines in a single window, the ROMs are repeated until there are enough machines
+ *
+ * @param instances amount of machines
+ * @param paths ROM files and directories
+ * @return 0 for successful run otherwise 1
+ */
+static int run_wall(const uint64_t instances, const std::vector<std::string>& paths) {
+  std::vector<std::string> roms = expand_roms(paths);
+  if(roms.empty() || instances == 0) {
+    std::cerr << "[WALL]: no ROM to run" << std::endl;
+    return 1;
+  }
+  std::vector<std::string> machines;
+  for(uint64_t i = 0; i < instances; i++)
+    machines.push_back(roms[i % roms.size()]);
+
+  Wall wall{machines};
+  wall.run();
+  return 0;
+}
+
+/**
+ * @param name name of a capture format
+ * @param format set to the matching format
+ * @return whether the name is a known format
+ */
+static bool parse_capture_format(const std::string& name, Capture_Format& format) {
+  const std::map<std::string, Capture_Format> formats {
+    {"ppm", Capture_Format::PPM}, {"png", Capture_Format::PNG}, {"raw", Capture_Format::RAW}, {"y4m", Capture_Format::Y4M}
+  };
+  auto found = formats.find(name);
+  if(found == formats.end())
+    return false;
+  format = found->second;
+  return true;
+}
 
 /**
  * this program emulates a chip8 machine 
  * 
  * @param argv[1] rom's path
+ * @param argv[2..] optional audio output: --mute or --wav <file>,
+ *                  optional debugger: --gdb <port | socket path>,
+ *                  optional recording: --capture <ppm | png | raw | y4m> <scale> <path>,
+ *                  optional --headless <frames> to run that many frames as fast as possible without a window,
+ *                  optional performance metrics: --metrics <port | file> exports them in the Prometheus text format,
+ *                  --overlay draws them over the screen (instructions per second, frames per second, p99 frame time in us)
  * @return 0 for successful run otherwise 1
+ *
+ * with --diff <instructions> <ROM file | directory>... the ROMs are checked headless instead,
+ * with --wall <instances> <ROM file | directory>... that many machines are shown in a single window
  */
 int main(int argc, char** argv) {
-  if(argc != 2) {
-    std::cerr << "[usage]: " << argv[0] << " <ROM file>" << std::endl; 
+  uint64_t count = 0;
+  if(argc >= 4 && std::string(argv[1]) == "--diff" && parse_count(argv[2], count))
+    return run_diff(count, std::vector<std::string>(argv + 3, argv + argc));
+  if(argc >= 4 && std::string(argv[1]) == "--wall" && parse_count(argv[2], count))
+    return run_wall(count, std::vector<std::string>(argv + 3, argv + argc));
+
+  bool mute = false, valid = argc >= 2 && std::string(argv[1]).rfind("--", 0) != 0; // a mode reaching here got bad arguments
+  bool overlay = false;
+  std::string wav_path, gdb_address, capture_path, metrics_target;
+  Capture_Format capture_format = Capture_Format::PPM;
+  int capture_scale = 1;
+  uint64_t headless_frames = 0;
+  for(int i = 2; i < argc && valid; i++) {
+    std::string arg = argv[i];
+    if(arg == "--mute")
+      mute = true;
+    else if(arg == "--wav" && i + 1 < argc)
+      wav_path = argv[++i];
+    else if(arg == "--gdb" && i + 1 < argc)
+      gdb_address = argv[++i];
+    else if(arg == "--capture" && i + 3 < argc && parse_capture_format(argv[i + 1], capture_format)) {
+      capture_scale = std::stoi(argv[i + 2]);
+      capture_path = argv[i + 3];
+      i += 3;
+    }
+    else if(arg == "--headless" && i + 1 < argc)
+      headless_frames = std::stoull(argv[++i]);
+    else if(arg == "--metrics" && i + 1 < argc)
+      metrics_target = argv[++i];
+    else if(arg == "--overlay")
+      overlay = true;
+    else
+      valid = false;
+  }
+  valid = valid && !(headless_frames && (!gdb_address.empty() || overlay)) && capture_scale > 0 && capture_scale <= 0xFF;
+  if(!valid) {
+    std::cerr << "[usage]: " << argv[0] << " <ROM file> [--mute | --wav <file>] [--gdb <port | socket path>]" << std::endl
+              << "                    [--capture <ppm | png | raw | y4m> <scale> <path>] [--headless <frames>]" << std::endl
+              << "                    [--metrics <port | file>] [--overlay]" << std::endl
+              << "         " << argv[0] << " --diff <instructions> <ROM file | directory>..." << std::endl
+              << "         " << argv[0] << " --wall <instances> <ROM file | directory>..." << std::endl;
     return 1;
   }
   else if(!std::filesystem::exists(std::string(argv[1]))) {
@@ -20,8 +182,49 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  Chip8 vm{argv[1]};
-  vm.run();
+  std::unique_ptr<Audio> audio;
+  if(!wav_path.empty())
+    audio = std::make_unique<Wav_Audio>(wav_path);
+  else if(mute || headless_frames)
+    audio = std::make_unique<Null_Audio>();
+  else
+    audio = std::make_unique<Stream_Audio>();
+
+  std::unique_ptr<Capture> capture;
+  if(!capture_path.empty())
+    capture = std::make_unique<Capture>(display_width, display_height, capture_scale, capture_path, capture_format);
+
+  /* the exporter is destroyed first, so its last export still sees the machine's metrics */
+  std::unique_ptr<Metrics> metrics;
+  std::unique_ptr<Metrics_Exporter> exporter;
+  if(!metrics_target.empty() || overlay)
+    metrics = std::make_unique<Metrics>(std::filesystem::path(argv[1]).filename().string());
+  if(!metrics_target.empty())
+    exporter = std::make_unique<Metrics_Exporter>(metrics_target);
 
+  Chip8_Settings settings;
+  settings.headless = headless_frames > 0;
+  settings.trace = !settings.headless;
+  settings.overlay = overlay;
+  Chip8 vm{argv[1], std::move(audio), settings};
+  vm.attach_capture(capture.get());
+  vm.attach_metrics(metrics.get());
+  std::unique_ptr<Gdb_Stub> debugger;
+  if(!gdb_address.empty()) {
+    debugger = std::make_unique<Gdb_Stub>(vm, gdb_address);
+    debugger->wait_for_client();
+    vm.attach_debugger(debugger.get());
+  }
+
+  if(settings.headless)
+    vm.run_headless(headless_frames);
+  else
+    vm.run();
+
+  if(capture) {
+    capture->stop();
+    std::cout << "[CAPTURE]: " << capture->written() << " frames written to " << capture_path << ", " 
+              << capture->dropped() << " dropped" << std::endl;
+  }
   return 0;
 }
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "metrics.hpp"
+
+constexpr double exported_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+constexpr uint16_t exporter_poll_ms = 100;
+constexpr uint8_t file_export_period = 10; // polls between two rewrites of the export file
+
+/**
+ * storing into a counter owned by the calling thread, no read-modify-write instruction is needed
+ */
+static void add(std::atomic<uint64_t>& counter, const uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * @return nanoseconds in a duration
+ */
+static uint64_t to_ns(const Metrics::Duration duration) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+/**
+ * constructor
+ */
+Histogram::Histogram() :
+          _count(0),
+          _sum(0)
+{
+  for(auto& bucket : _buckets)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @param value value to be recorded, clamped to 32 bits
+ */
+void Histogram::record(uint64_t value) {
+  value = std::min<uint64_t>(value, UINT32_MAX);
+  add(_buckets[bucket_index(value)], 1);
+  add(_sum, value);
+  /* published last, a reader seeing the count sees the bucket too */
+  _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @param fraction percentile as a fraction, e.g 0.99
+ * @return highest value equivalent to the percentile's bucket, 0 if nothing was recorded
+ */
+uint64_t Histogram::percentile(const double fraction) const {
+  uint64_t total = _count.load(std::memory_order_acquire);
+  if(total == 0)
+    return 0;
+  uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * total)), seen = 0;
+  for(uint16_t i = 0; i < bucket_count; i++) {
+    seen += _buckets[i].load(std::memory_order_relaxed);
+    if(seen >= rank)
+      return bucket_value(i);
+  }
+  return bucket_value(bucket_count - 1);
+}
+
+/**
+ * @return bucket holding a value
+ */
+uint16_t Histogram::bucket_index(const uint64_t value) {
+  if(value < sub_bucket_count)
+    return value;
+  uint8_t msb = 63 - __builtin_clzll(value),
+          shift = msb - (sub_bucket_bits - 1);
+  return sub_bucket_count + (shift - 1) * half_count + ((value >> shift) - half_count);
+}
+
+/**
+ * @return highest value held by a bucket
+ */
+uint64_t Histogram::bucket_value(const uint16_t index) {
+  if(index < sub_bucket_count)
+    return index;
+  uint8_t shift = (index - sub_bucket_count) / half_count + 1;
+  uint64_t mantissa = (index - sub_bucket_count) % half_count + half_count;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * constructor, registering the instance for export
+ *
+ * @param machine name of the machine, made unique with a number
+ */
+Metrics::Metrics(const std::string& machine) :
+                _machine([&machine]() {
+                  static std::atomic<uint32_t> next_id(0);
+                  return machine + "#" + std::to_string(next_id++);
+                }()),
+                _overlay_time(std::chrono::steady_clock::now()),
+                _overlay_instructions(0),
+                _overlay_frames(0)
+{
+  for(auto* counter : {&_counters.instructions, &_counters.frames, &_counters.late_frames, &_counters.dropped_frames,
+                       &_counters.dispatch_ns, &_counters.render_ns, &_counters.sleep_ns})
+    counter->store(0, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  registry().push_back(this);
+}
+
+/**
+ * destructor, unregistering the instance
+ */
+Metrics::~Metrics() {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  auto& instances = registry();
+  instances.erase(std::remove(instances.begin(), instances.end(), this), instances.end());
+}
+
+/**
+ * recording a completed frame
+ *
+ * @param instructions instructions executed by the machine so far
+ * @param dispatch time spent handling events and executing the frame's instructions
+ * @param render time spent drawing the frame
+ * @param sleep time spent waiting for the next frame
+ * @param frame_time time between the start of this frame and the start of the next one
+ * @param late whether the frame missed its deadline
+ */
+void Metrics::record_frame(const uint64_t instructions, const Duration dispatch, const Duration render,
+                           const Duration sleep, const Duration frame_time, const bool late) {
+  _counters.instructions.store(instructions, std::memory_order_relaxed);
+  add(_counters.frames, 1);
+  add(_counters.late_frames, late);
+  add(_counters.dispatch_ns, to_ns(dispatch));
+  add(_counters.render_ns, to_ns(render));
+  add(_counters.sleep_ns, to_ns(sleep));
+  _frame_time_ns.record(to_ns(frame_time));
+}
+
+/**
+ * @param frames deadlines skipped because the machine fell behind real time
+ */
+void Metrics::record_dropped(const uint64_t frames) {
+  add(_counters.dropped_frames, frames);
+}
+
+/**
+ * computing the overlay of the window since the last call:
+ * instructions per second, frames per second and the 99th percentile frame time in microseconds, one per line
+ *
+ * @return the overlay text
+ */
+std::string Metrics::overlay_text() {
+  auto now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - _overlay_time).count();
+  uint64_t instructions = _counters.instructions.load(std::memory_order_relaxed),
+           frames = _counters.frames.load(std::memory_order_relaxed);
+  if(seconds <= 0)
+    return "";
+
+  std::ostringstream text;
+  text << std::llround((instructions - _overlay_instructions) / seconds) << "\n"
+       << std::llround((frames - _overlay_frames) / seconds) << "\n"
+       << _frame_time_ns.percentile(0.99) / 1000;
+  _overlay_time = now;
+  _overlay_instructions = instructions;
+  _overlay_frames = frames;
+  return text.str();
+}
+
+/**
+ * @return metrics of every live instance in the Prometheus text format
+ */
+std::string Metrics::export_text() {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  const auto& instances = registry();
+  std::ostringstream text;
+
+  auto label = [](const Metrics* metrics) {
+    std::string escaped;
+    for(char c : metrics->_machine) {
+      if(c == '"' || c == '\\')
+        escaped += '\\';
+      escaped += c;
+    }
+    /* "instance" is the label Prometheus attaches to the scraped target, the machine gets its own */
+    return "machine=\"" + escaped + "\"";
+  };
+  auto counter = [&](const std::string& name, const std::string& help, std::atomic<uint64_t> Counters::*field) {
+    text << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+    for(const Metrics* metrics : instances)
+      text << name << "{" << label(metrics) << "} " << (metrics->_counters.*field).load(std::memory_order_relaxed) << "\n";
+  };
+
+  counter("chip8_instructions_total", "Instructions executed.", &Counters::instructions);
+  counter("chip8_frames_total", "Frames emitted.", &Counters::frames);
+  counter("chip8_late_frames_total", "Frames that missed their deadline.", &Counters::late_frames);
+  counter("chip8_dropped_frames_total", "Frame deadlines skipped after falling behind real time.", &Counters::dropped_frames);
+
+  text << "# HELP chip8_phase_seconds_total Time spent per phase of the frame loop.\n"
+       << "# TYPE chip8_phase_seconds_total counter\n";
+  for(const Metrics* metrics : instances) {
+    text << "chip8_phase_seconds_total{" << label(metrics) << ",phase=\"dispatch\"} "
+         << metrics->_counters.dispatch_ns.load(std::memory_order_relaxed) / 1e9 << "\n"
+         << "chip8_phase_seconds_total{" << label(metrics) << ",phase=\"render\"} "
+         << metrics->_counters.render_ns.load(std::memory_order_relaxed) / 1e9 << "\n"
+         << "chip8_phase_seconds_total{" << label(metrics) << ",phase=\"sleep\"} "
+         << metrics->_counters.sleep_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+  }
+
+  text << "# HELP chip8_frame_time_seconds Time between the starts of two frames.\n"
+       << "# TYPE chip8_frame_time_seconds summary\n";
+  for(const Metrics* metrics : instances) {
+    for(double quantile : exported_quantiles)
+      text << "chip8_frame_time_seconds{" << label(metrics) << ",quantile=\"" << quantile << "\"} "
+           << metrics->_frame_time_ns.percentile(quantile) / 1e9 << "\n";
+    text << "chip8_frame_time_seconds_sum{" << label(metrics) << "} " << metrics->_frame_time_ns.sum() / 1e9 << "\n"
+         << "chip8_frame_time_seconds_count{" << label(metrics) << "} " << metrics->_frame_time_ns.count() << "\n";
+  }
+  return text.str();
+}
+
+std::mutex& Metrics::registry_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<Metrics*>& Metrics::registry() {
+  static std::vector<Metrics*> instances;
+  return instances;
+}
+
+/**
+ * constructor, starting the export thread
+ *
+ * @param target TCP port on localhost to serve the metrics on, or a file path to write them to
+ */
+Metrics_Exporter::Metrics_Exporter(const std::string& target) :
+                                  _file_path(std::all_of(target.begin(), target.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }) ? "" : target),
+                                  _server(-1),
+                                  _stop(false)
+{
+  if(_file_path.empty()) {
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(std::stoul(target)));
+    _server = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if(_server >= 0)
+      setsockopt(_server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(_server < 0 || bind(_server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(_server, 4) < 0)
+      throw std::runtime_error("can not bind metrics socket");
+    _thread = std::thread(&Metrics_Exporter::serve_loop, this);
+  }
+  else
+    _thread = std::thread(&Metrics_Exporter::write_loop, this);
+}
+
+/**
+ * destructor, stopping the export thread
+ */
+Metrics_Exporter::~Metrics_Exporter() {
+  _stop.store(true);
+  _thread.join();
+  if(_server >= 0)
+    close(_server);
+}
+
+/**
+ * answering every HTTP request with the metrics
+ */
+void Metrics_Exporter::serve_loop() {
+  pollfd server_fd {_server, POLLIN, 0};
+  while(!_stop.load()) {
+    if(poll(&server_fd, 1, exporter_poll_ms) <= 0)
+      continue;
+    int client = accept(_server, nullptr, nullptr);
+    if(client < 0)
+      continue;
+
+    /* the request itself doesn't matter, reading it until its headers end */
+    std::string request;
+    char buffer[512];
+    pollfd client_fd {client, POLLIN, 0};
+    while(request.find("\r\n\r\n") == std::string::npos && request.size() < 8192 && poll(&client_fd, 1, exporter_poll_ms) > 0) {
+      ssize_t len = recv(client, buffer, sizeof(buffer), 0);
+      if(len <= 0)
+        break;
+      request.append(buffer, len);
+    }
+
+    std::string body = Metrics::export_text();
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                           + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while(sent < response.size()) {
+      ssize_t len = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if(len <= 0)
+        break;
+      sent += len;
+    }
+    close(client);
+  }
+}
+
+/**
+ * rewriting the export file every second, replacing it atomically so a scraper never reads half of it
+ */
+void Metrics_Exporter::write_loop() {
+  uint8_t polls = 0;
+  bool stop = false;
+  while(!stop) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(exporter_poll_ms));
+    stop = _stop.load();
+    if(++polls < file_export_period && !stop)
+      continue;
+    polls = 0;
+
+    std::string tmp_path = _file_path + ".tmp";
+    {
+      std::ofstream file(tmp_path);
+      file << Metrics::export_text();
+    }
+    std::rename(tmp_path.c_str(), _file_path.c_str());
+  }
+}
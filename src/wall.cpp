@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include "wall.hpp"
+
+constexpr uint8_t tile_gap = 1, // texels between two tiles, drawn in gray
+                  max_scale_factor = 10;
+constexpr uint16_t tile_width = display_width + tile_gap, // a tile and the gap on its right
+                   tile_height = display_height + tile_gap; // a tile and the gap below it
+
+/**
+ * constructor, loading a machine for every ROM and creating the window
+ *
+ * @param paths ROM files, a path may be given more than once to run several copies of a ROM
+ */
+Wall::Wall(const std::vector<std::string>& paths) :
+          _halted(paths.size(), false),
+          _columns(std::ceil(std::sqrt(paths.size()))),
+          _rows(_columns ? (paths.size() + _columns - 1) / _columns : 0),
+          _window(sf::VideoMode(atlas_width() * fit_scale_factor(), atlas_height() * fit_scale_factor()),
+                  "chip8 wall (" + std::to_string(paths.size()) + ")"),
+          _tile(display_width * display_height * 4, 0xFF)
+{
+  if(paths.empty())
+    throw std::invalid_argument("the wall needs at least one ROM");
+  if(atlas_width() > sf::Texture::getMaximumSize() || atlas_height() > sf::Texture::getMaximumSize())
+    throw std::invalid_argument("too many machines for a single texture");
+
+  /* every machine gets its own seed so copies of a ROM don't play in unison */
+  for(size_t i = 0; i < paths.size(); i++) {
+    Chip8_Settings settings;
+    settings.headless = true;
+    settings.trace = false;
+    settings.backend = Backend::DECODED;
+    settings.seed = i + 1;
+    _machines.push_back(std::make_unique<Chip8>(paths[i], std::make_unique<Null_Audio>(), settings));
+  }
+
+  /* the gaps between the tiles are drawn once */
+  std::vector<sf::Uint8> background(atlas_width() * atlas_height() * 4, 0x40);
+  for(size_t px = 3; px < background.size(); px += 4)
+    background[px] = 0xFF;
+  _atlas.create(atlas_width(), atlas_height());
+  _atlas.update(background.data());
+  for(size_t i = 0; i < _machines.size(); i++)
+    update_tile(i);
+
+  _sprite.setTexture(_atlas);
+  float scale = fit_scale_factor();
+  _sprite.setScale(scale, scale);
+  auto desk { sf::VideoMode::getDesktopMode() };
+  _window.setPosition(sf::Vector2i(desk.width / 8, desk.height / 8));
+}
+
+/**
+ * running every machine frame by frame at frame_rate until the window is closed.
+ * a wall that falls more than a frame behind skips the missed deadlines
+ */
+void Wall::run() {
+  constexpr std::chrono::microseconds frame_duration(1000000 / frame_rate);
+  auto next_frame = std::chrono::steady_clock::now() + frame_duration;
+  sf::Event event;
+  while(_window.isOpen()) {
+    while(_window.pollEvent(event)) {
+      switch (event.type) {
+        case sf::Event::Closed:
+          _window.close();
+          break;
+        /* every machine gets the keys, escape closes the wall */
+        case sf::Event::KeyPressed:
+          if(event.key.code == sf::Keyboard::Escape) {
+            _window.close();
+            break;
+          }
+          [[fallthrough]];
+        case sf::Event::KeyReleased:
+          for(auto& machine : _machines)
+            machine->update_key(event, static_cast<uint8_t>(event.type == sf::Event::KeyPressed ? Key_State::PRESSED : Key_State::RELEASED));
+          break;
+        default:
+          break;
+      }
+    }
+
+    run_frame();
+    _window.clear(sf::Color::Black);
+    _window.draw(_sprite);
+    _window.display();
+
+    auto now = std::chrono::steady_clock::now();
+    if(now > next_frame)
+      next_frame += ((now - next_frame) / frame_duration) * frame_duration;
+    std::this_thread::sleep_until(next_frame);
+    next_frame += frame_duration;
+  }
+}
+
+/**
+ * running a frame on every machine and uploading the tiles that changed
+ */
+void Wall::run_frame() {
+  for(size_t i = 0; i < _machines.size(); i++) {
+    if(_halted[i])
+      continue;
+    try {
+      _machines[i]->run_frame();
+    }
+    catch(const std::exception&) {
+      _halted[i] = true;
+    }
+    if(_machines[i]->take_draw_flag())
+      update_tile(i);
+  }
+}
+
+/**
+ * uploading the screen of a machine to its tile of the atlas
+ *
+ * @param machine index of the machine
+ */
+void Wall::update_tile(const size_t machine) {
+  const auto& screen = _machines[machine]->display();
+  sf::Uint8* px = _tile.data();
+  for(const auto& row : screen) {
+    for(uint8_t pixel : row) {
+      std::fill(px, px + 3, pixel ? 0xFF : 0x00); // alpha stays opaque
+      px += 4;
+    }
+  }
+  _atlas.update(_tile.data(), display_width, display_height,
+                (machine % _columns) * tile_width + tile_gap, (machine / _columns) * tile_height + tile_gap);
+}
+
+/**
+ * @return width of the atlas in texels, the tiles and the gaps around them
+ */
+uint16_t Wall::atlas_width() const {
+  return _columns * tile_width + tile_gap;
+}
+
+/**
+ * @return height of the atlas in texels, the tiles and the gaps around them
+ */
+uint16_t Wall::atlas_height() const {
+  return _rows * tile_height + tile_gap;
+}
+
+/**
+ * @return largest scale factor (up to max_scale_factor) at which the grid fits in 3/4 of the desktop, at least 1
+ */
+uint8_t Wall::fit_scale_factor() const {
+  auto desk { sf::VideoMode::getDesktopMode() };
+  unsigned scale = std::min(desk.width * 3 / 4 / atlas_width(), desk.height * 3 / 4 / atlas_height());
+  return std::clamp<unsigned>(scale, 1, max_scale_factor);
+}